@@ -4,6 +4,10 @@
 #include <linux/fs.h>
 #include <asm/uaccess.h>
 #include <linux/uaccess.h>
+#include <linux/moduleparam.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
 #include "ddriver_ctl.h"
 /******************************************************************************
 * SECTION: Macro definitions
@@ -41,9 +45,9 @@
 #define SET_HEAD(disk, ofs)     (disk.head = disk.layout + ofs)
 #define RESET_HEAD(disk)        (SET_HEAD(disk, 0))
 
-#define INC_READCNT(disk)       (disk.read_cnt++)
-#define INC_WRITECNT(disk)      (disk.write_cnt++)
-#define INC_SEEKCNT(disk)       (disk.seek_cnt++)
+#define INC_READCNT(disk)       (disk.stats.read_cnt++)
+#define INC_WRITECNT(disk)      (disk.stats.write_cnt++)
+#define INC_SEEKCNT(disk)       (disk.stats.seek_cnt++)
 /******************************************************************************
 * SECTION: Kernel Module Template
 *******************************************************************************/
@@ -51,27 +55,27 @@ MODULE_LICENSE("GPL");
 MODULE_AUTHOR(DRIVER_AUTHOR);	    
 MODULE_DESCRIPTION(DRIVER_DESC);	
 MODULE_VERSION(DRIVER_VERSION);	
+
+static unsigned long disk_size = CONFIG_DISK_SZ;
+module_param(disk_size, ulong, 0444);
+MODULE_PARM_DESC(disk_size, "Disk size in bytes, aligned to 512 (default 4MB)");
 /******************************************************************************
 * SECTION: Type definitions
 *******************************************************************************/
 struct ddriver
 {
-    char layout[CONFIG_DISK_SZ];                      /* Disk Layout */
+    char *layout;                                     /* Disk Layout, vmalloc'ed */
     char *head;                                       /* Disk Head */
-    int  read_cnt;
-    int  write_cnt;
-    int  seek_cnt;
+    struct ddriver_stats stats;                       /* Counters, bytes, latency, histograms */
     int  major_num;
     int  open_count;
-    int  layout_size;
+    loff_t layout_size;
     int  iounit_size;
 };
 
 static struct ddriver disk = {
+    .layout      = NULL,
     .head        = NULL,
-    .read_cnt    = 0,
-    .write_cnt   = 0,
-    .seek_cnt    = 0,
     .major_num   = 0,
     .open_count  = 0,
     .layout_size = CONFIG_DISK_SZ,
@@ -81,7 +85,7 @@ static struct ddriver disk = {
 * SECTION: Helper Functions
 *******************************************************************************/
 int check_valid(size_t size){
-    if (GET_HEAD_POS(disk) >=  CONFIG_DISK_SZ) {
+    if (GET_HEAD_POS(disk) + CONFIG_BLOCK_SZ > disk.layout_size) {
         kernel_alert("disk head reach the end");
         return -EINVAL;
     }
@@ -91,6 +95,41 @@ int check_valid(size_t size){
     }
     return 0;
 }
+static int log2_bucket(u64 val, int nr_buckets) {
+    int bucket = val == 0 ? 0 : ilog2(val);
+    return bucket >= nr_buckets ? nr_buckets - 1 : bucket;
+}
+/**
+ * @brief Account one read/write. No latency is emulated here, so the 
+ *        latency recorded is the time spent copying to/from user space
+ */
+static void record_io(int is_write, size_t size, u64 start_ns) {
+    u64 lat_us = div_u64(ktime_get_ns() - start_ns, 1000);
+    if (is_write) {
+        INC_WRITECNT(disk);
+        disk.stats.write_bytes += size;
+        disk.stats.write_lat_us += lat_us;
+        disk.stats.write_lat_hist[log2_bucket(lat_us, DDRIVER_LAT_HIST_BUCKETS)]++;
+    }
+    else {
+        INC_READCNT(disk);
+        disk.stats.read_bytes += size;
+        disk.stats.read_lat_us += lat_us;
+        disk.stats.read_lat_hist[log2_bucket(lat_us, DDRIVER_LAT_HIST_BUCKETS)]++;
+    }
+}
+
+static void record_seek(loff_t start, loff_t end) {
+    u64 sectors = (start > end ? start - end : end - start) / CONFIG_BLOCK_SZ;
+    disk.stats.seek_sectors += sectors;
+    disk.stats.seek_hist[log2_bucket(sectors, DDRIVER_SEEK_HIST_BUCKETS)]++;
+}
+
+static void reset_stats(void) {
+    memset(&disk.stats, 0, sizeof(disk.stats));
+    disk.stats.reset_mono_ns = ktime_get_ns();
+    disk.stats.reset_real_ns = ktime_get_real_ns();
+}
 /******************************************************************************
 * SECTION: Function definitions
 *******************************************************************************/
@@ -127,13 +166,14 @@ static ssize_t
 device_read(struct file *file, char *user_buffer, size_t size, loff_t *offset) {
     IGNORE_ARG(offset);
     IGNORE_ARG(file);
+    u64 start_ns = ktime_get_ns();
     int res = check_valid(size);
     if(res < 0)
         return res;
     if (copy_to_user(user_buffer, disk.head, CONFIG_BLOCK_SZ))
         return -EFAULT;
     FORWARD_HEAD(disk, CONFIG_BLOCK_SZ);
-    INC_READCNT(disk);
+    record_io(0, CONFIG_BLOCK_SZ, start_ns);
     return CONFIG_BLOCK_SZ;
 }
 /**
@@ -149,6 +189,7 @@ static ssize_t
 device_write(struct file *file, const char *user_buffer, size_t size, loff_t *offset) {
     IGNORE_ARG(offset);
     IGNORE_ARG(file);
+    u64 start_ns = ktime_get_ns();
     int res = check_valid(size);
     if(res < 0)
         return res;
@@ -156,7 +197,7 @@ device_write(struct file *file, const char *user_buffer, size_t size, loff_t *of
     if (copy_from_user(disk.head, user_buffer, CONFIG_BLOCK_SZ))
         return -EFAULT;
     FORWARD_HEAD(disk, CONFIG_BLOCK_SZ);
-    INC_WRITECNT(disk);
+    record_io(1, CONFIG_BLOCK_SZ, start_ns);
     return CONFIG_BLOCK_SZ;
 }
 /**
@@ -170,6 +211,7 @@ device_write(struct file *file, const char *user_buffer, size_t size, loff_t *of
 static loff_t 
 device_seek(struct file *file, loff_t offset, int whence) {
     IGNORE_ARG(file);
+    loff_t from = GET_HEAD_POS(disk);
     if (!IS_ADDR_ALIGN(offset)) {
         kernel_alert("offset %lld must be aligned to block size %d", 
                       offset, CONFIG_BLOCK_SZ);
@@ -187,6 +229,7 @@ device_seek(struct file *file, loff_t offset, int whence) {
         break;
     }
     INC_SEEKCNT(disk);
+    record_seek(from, GET_HEAD_POS(disk));
     return GET_HEAD_POS(disk);
 }
 /**
@@ -201,27 +244,45 @@ static long
 device_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
     IGNORE_ARG(file);
     int ret;
+    int size;
+    u64 size64;
     struct ddriver_state state;
     switch (cmd)
     {
     case IOC_REQ_DEVICE_SIZE:                         /* Device Size */
-        ret = copy_to_user((int __user *)arg, &disk.layout_size, sizeof(int));
+        /* 超出int时截到扇区整数倍，完整大小用IOC_REQ_DEVICE_SIZE64 */
+        size = disk.layout_size > INT_MAX ? (INT_MAX & ~(CONFIG_BLOCK_SZ - 1)) : disk.layout_size;
+        ret = copy_to_user((int __user *)arg, &size, sizeof(int));
+        if (ret) 
+            return -EFAULT;
+        break;
+    case IOC_REQ_DEVICE_SIZE64:                       /* Device Size, 64-bit */
+        size64 = disk.layout_size;
+        ret = copy_to_user((u64 __user *)arg, &size64, sizeof(u64));
         if (ret) 
             return -EFAULT;
         break;
     case IOC_REQ_DEVICE_STATE:                        /* Device State */
-        state.read_cnt = disk.read_cnt;
-        state.write_cnt = disk.write_cnt;
-        state.seek_cnt = disk.seek_cnt;
+        state.read_cnt = disk.stats.read_cnt;
+        state.write_cnt = disk.stats.write_cnt;
+        state.seek_cnt = disk.stats.seek_cnt;
         ret = copy_to_user((int __user *)arg, &state, sizeof(struct ddriver_state));
         if (ret) 
             return -EFAULT;
         break;
     case IOC_REQ_DEVICE_RESET:                        /* Reset Device */
         disk.head = disk.layout;
-        disk.read_cnt = 0;
-        disk.write_cnt = 0;
-        disk.seek_cnt = 0;
+        reset_stats();
+        break;
+    case IOC_REQ_DEVICE_STATS:                        /* Detailed Statistics */
+        disk.stats.now_mono_ns = ktime_get_ns();
+        ret = copy_to_user((struct ddriver_stats __user *)arg, &disk.stats, 
+                           sizeof(struct ddriver_stats));
+        if (ret) 
+            return -EFAULT;
+        break;
+    case IOC_REQ_DEVICE_STATS_RESET:                  /* Reset Statistics Only */
+        reset_stats();
         break;
     case IOC_REQ_DEVICE_IO_SZ:
         ret = copy_to_user((int __user *)arg, &disk.iounit_size, sizeof(int));
@@ -276,16 +337,30 @@ device_release(struct inode *inode, struct file *file) {
 static int __init 
 ddriver_init(void)
 {
-    int major_num = register_chrdev(0, DEVICE_NAME, &file_ops);   
+    int major_num;
+
+    if (disk_size < CONFIG_BLOCK_SZ || !IS_ADDR_ALIGN(disk_size)) {
+        kernel_alert("disk_size %lu must be aligned to %d", disk_size, CONFIG_BLOCK_SZ);
+        return -EINVAL;
+    }
+    disk.layout = vzalloc(disk_size);                 /* Allocate disk layout */
+    if (disk.layout == NULL) {
+        kernel_alert("Can't allocate %lu bytes for disk", disk_size);
+        return -ENOMEM;
+    }
+    disk.layout_size = disk_size;
+    reset_stats();
+
+    major_num = register_chrdev(0, DEVICE_NAME, &file_ops);   
                                                       /* Register an device */
     if (major_num < 0) {                              /* Register fail */
         kernel_alert("Can't register device, ret %d", major_num);
+        vfree(disk.layout);
         return major_num;
     } 
     else {                                            /* Register success */                                                  
         kernel_info("module loaded with device major number %d", major_num);
         disk.major_num = major_num;
-        memset(disk.layout, 0, CONFIG_DISK_SZ);
         return 0;
     }
     return 0;
@@ -299,6 +374,7 @@ ddriver_exit(void)
     if(major_num != 0){
         unregister_chrdev(major_num, DEVICE_NAME);
     }
+    vfree(disk.layout);
 }
 
 module_init(ddriver_init);
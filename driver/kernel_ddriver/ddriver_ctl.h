@@ -2,6 +2,7 @@
 #define _DDRIVER_CTL_H_
 
 #include <linux/ioctl.h>   
+#include <linux/types.h>
 /******************************************************************************
 * SECTION: IO ctl protocol definitions
 *******************************************************************************/
@@ -14,8 +15,32 @@ struct ddriver_state
     int seek_cnt;
 };
 
+#define DDRIVER_SEEK_HIST_BUCKETS   32
+#define DDRIVER_LAT_HIST_BUCKETS    32
+struct ddriver_stats
+{
+    __u64 read_cnt;
+    __u64 write_cnt;
+    __u64 seek_cnt;
+    __u64 read_bytes;
+    __u64 write_bytes;
+    __u64 seek_sectors;                           /* 累计寻道距离(扇区) */
+    __u64 read_lat_us;                            /* 读请求累计延迟(不含寻道) */
+    __u64 write_lat_us;                           /* 写请求累计延迟(不含寻道) */
+    __u64 seek_lat_us;                            /* 寻道(旋转)累计延迟，寻道时间只计在这里 */
+    __u32 seek_hist[DDRIVER_SEEK_HIST_BUCKETS];   /* bucket[i]: 寻道距离在[2^i, 2^(i+1))个扇区内的次数 */
+    __u32 read_lat_hist[DDRIVER_LAT_HIST_BUCKETS];  /* bucket[i]: 延迟在[2^i, 2^(i+1))us内的次数, 0计入bucket[0] */
+    __u32 write_lat_hist[DDRIVER_LAT_HIST_BUCKETS];
+    __u64 reset_mono_ns;                          /* 上次清零时刻, CLOCK_MONOTONIC */
+    __u64 reset_real_ns;                          /* 上次清零时刻, CLOCK_REALTIME */
+    __u64 now_mono_ns;                            /* 取样时刻, CLOCK_MONOTONIC */
+};
+
 #define IOC_REQ_DEVICE_SIZE     _IOR(IOC_MAGIC, 0, int)
 #define IOC_REQ_DEVICE_STATE    _IOR(IOC_MAGIC, 1, struct ddriver_state)
 #define IOC_REQ_DEVICE_RESET    _IO(IOC_MAGIC, 2)
 #define IOC_REQ_DEVICE_IO_SZ    _IOR(IOC_MAGIC, 3, int)
+#define IOC_REQ_DEVICE_SIZE64   _IOR(IOC_MAGIC, 7, __u64)
+#define IOC_REQ_DEVICE_STATS    _IOR(IOC_MAGIC, 9, struct ddriver_stats)
+#define IOC_REQ_DEVICE_STATS_RESET _IO(IOC_MAGIC, 10)
 #endif
\ No newline at end of file
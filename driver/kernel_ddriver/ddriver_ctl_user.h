@@ -2,6 +2,7 @@
 #define _DDRIVER_CTL_H_
 
 #include <sys/ioctl.h>   
+#include <stdint.h>
 /******************************************************************************
 * SECTION: IO ctl protocol definitions
 *******************************************************************************/
@@ -13,9 +14,33 @@ struct ddriver_state
     int seek_cnt;
 };
 
+#define DDRIVER_SEEK_HIST_BUCKETS   32
+#define DDRIVER_LAT_HIST_BUCKETS    32
+struct ddriver_stats
+{
+    uint64_t read_cnt;
+    uint64_t write_cnt;
+    uint64_t seek_cnt;
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    uint64_t seek_sectors;                           /* 累计寻道距离(扇区) */
+    uint64_t read_lat_us;                            /* 读请求累计延迟(不含寻道) */
+    uint64_t write_lat_us;                           /* 写请求累计延迟(不含寻道) */
+    uint64_t seek_lat_us;                            /* 寻道(旋转)累计延迟，寻道时间只计在这里 */
+    uint32_t seek_hist[DDRIVER_SEEK_HIST_BUCKETS];   /* bucket[i]: 寻道距离在[2^i, 2^(i+1))个扇区内的次数 */
+    uint32_t read_lat_hist[DDRIVER_LAT_HIST_BUCKETS];  /* bucket[i]: 延迟在[2^i, 2^(i+1))us内的次数, 0计入bucket[0] */
+    uint32_t write_lat_hist[DDRIVER_LAT_HIST_BUCKETS];
+    uint64_t reset_mono_ns;                          /* 上次清零时刻, CLOCK_MONOTONIC */
+    uint64_t reset_real_ns;                          /* 上次清零时刻, CLOCK_REALTIME */
+    uint64_t now_mono_ns;                            /* 取样时刻, CLOCK_MONOTONIC */
+};
+
 #define IOC_REQ_DEVICE_SIZE     _IOR(IOC_MAGIC, 0, int)
 #define IOC_REQ_DEVICE_STATE    _IOR(IOC_MAGIC, 1, struct ddriver_state)
 #define IOC_REQ_DEVICE_RESET    _IO(IOC_MAGIC, 2)
 #define IOC_REQ_DEVICE_IO_SZ    _IOR(IOC_MAGIC, 3, int)
+#define IOC_REQ_DEVICE_SIZE64   _IOR(IOC_MAGIC, 7, uint64_t)
+#define IOC_REQ_DEVICE_STATS    _IOR(IOC_MAGIC, 9, struct ddriver_stats)
+#define IOC_REQ_DEVICE_STATS_RESET _IO(IOC_MAGIC, 10)
 
 #endif
\ No newline at end of file
@@ -2,6 +2,8 @@
 #include "stdlib.h"
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include "string.h"
 #include <linux/fs.h>
@@ -10,6 +12,11 @@
 #include "errno.h"
 #include <pwd.h>
 #include <time.h>
+#include <pthread.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
 
 extern int errno;
 
@@ -22,6 +29,11 @@ extern int errno;
 *******************************************************************************/   
 #define DEVICE_NAME   "ddriver"
 #define DEVICE_LOG    "ddriver_log"
+#define ENV_BACKEND   "DDRIVER_BACKEND"               /* file | mmap */
+#define ENV_LATENCY   "DDRIVER_LATENCY"               /* emulate | raw */
+#define ENV_AIO       "DDRIVER_AIO"                   /* uring | pool */
+#define ENV_SIZE      "DDRIVER_SIZE"                  /* bytes, K/M/G suffix allowed */
+#define ENV_SCHED     "DDRIVER_SCHED"                 /* noop | scan | deadline */
 
 #define user_info(fmt, ...)\
 	do {\
@@ -46,6 +58,14 @@ extern int errno;
 
 #define CONFIG_DISK_SZ  (4 * 1024 * 1024)
 #define CONFIG_BLOCK_SZ (512)
+
+#define AIO_ENGINE_NONE  0
+#define AIO_ENGINE_URING 1
+#define AIO_ENGINE_POOL  2
+#define AIO_POOL_THREADS 4
+
+#define SCHED_READ_EXPIRE_MS  50                     /* deadline: 读请求最长等待 */
+#define SCHED_WRITE_EXPIRE_MS 500                    /* deadline: 写请求最长等待 */
 /******************************************************************************
 * SECTION: Macro Functions 
 *******************************************************************************/
@@ -53,36 +73,96 @@ extern int errno;
 #define IS_ADDR_ALIGN(addr)     (addr % CONFIG_BLOCK_SZ == 0)
 #define ADDR_ROUND_UP(addr)     ((addr / CONFIG_BLOCK_SZ) * CONFIG_BLOCK_SZ)
 
-#define INC_READCNT(disk)       (disk.read_cnt++)
-#define INC_WRITECNT(disk)      (disk.write_cnt++)
-#define INC_SEEKCNT(disk)       (disk.seek_cnt++)
+#define INC_READCNT(disk)       (disk.stats.read_cnt++)
+#define INC_WRITECNT(disk)      (disk.stats.write_cnt++)
+#define INC_SEEKCNT(disk)       (disk.stats.seek_cnt++)
+#define DISK_LOCK(disk)         (pthread_mutex_lock(&disk.lock))
+#define DISK_UNLOCK(disk)       (pthread_mutex_unlock(&disk.lock))
+#define DISK_AT_HEAD            ((off_t)-1)         /* 从共享磁头处读写，磁头在记账时持锁读取 */
 
-#define RW_DELAY(disk, rw_ops)  (usleep(disk.rw_ops##_lat * 1000))
+#define IS_RAW_LAT(disk)        (disk.lat_mode == DDRIVER_LAT_RAW)
+#define RW_DELAY(disk, rw_ops)  do { if (!IS_RAW_LAT(disk)) usleep(disk.rw_ops##_lat * 1000); } while (0)
 /******************************************************************************
 * SECTION: Type definitions
 *******************************************************************************/
 struct ddriver
 {
     int  ddriver_fd;                                 /* Disk ddriver_fd */
-    int  read_cnt;
-    int  write_cnt;
-    int  seek_cnt;
+    struct ddriver_stats stats;                      /* Counters, bytes, latency, histograms */
+    off_t head;                                      /* Disk head position */
+    pthread_mutex_t lock;                            /* Protects head and stats */
+    int  backend;                                    /* DDRIVER_BACKEND_* */
+    int  lat_mode;                                   /* DDRIVER_LAT_* */
+    char *map;                                       /* Image mapping (mmap backend) */
     int  read_lat;
     int  write_lat;
     int  seek_lat;
     int  track_num;
     int  major_num;
-    int  layout_size;
+    off_t layout_size;                               /* Device size, set at open */
     int  iounit_size;
 };
+struct aio_slot
+{
+    struct ddriver_req *req;
+    size_t total;                                    /* Bytes of this request */
+    int    is_write;
+    struct timespec expire;                          /* Deadline scheduler: serve by */
+    /* Valid on the first slot of a dispatched IO */
+    int    merge_next;                               /* Next slot merged into the IO, -1 ends */
+    const struct iovec *io_iov;
+    struct iovec *merged_iov;                        /* Concatenated iov when merged */
+    int    io_iovcnt;
+    size_t io_total;
+    off_t  from;                                     /* Head position before the IO */
+    int    res;                                      /* Result from pool worker */
+    struct timespec deadline;                        /* Emulated latency expiry */
+};
+struct aio_ctx
+{
+    int  engine;                                     /* AIO_ENGINE_* */
+    int  fd;
+    int  inflight;
+    struct aio_slot slot[DDRIVER_QUEUE_DEPTH];
+    int  free_stack[DDRIVER_QUEUE_DEPTH];
+    int  free_cnt;
+    /* io_uring */
+    int  ring_fd;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_sz, cq_sz, sqes_sz;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    /* thread pool */
+    pthread_t workers[AIO_POOL_THREADS];
+    int  nr_workers;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+    int  pend[DDRIVER_QUEUE_DEPTH];                  /* FIFO of slot index */
+    int  pend_head, pend_cnt;
+    int  done[DDRIVER_QUEUE_DEPTH];
+    int  done_head, done_cnt;
+    int  stop;
+    /* scheduler */
+    int  sched;                                      /* DDRIVER_SCHED_* */
+    int  queued[DDRIVER_QUEUE_DEPTH];                /* Plugged, not yet dispatched */
+    int  queued_cnt;
+    int  merge_cnt;
+    int  ready[DDRIVER_QUEUE_DEPTH];                 /* Completed, not yet reaped */
+    int  ready_head, ready_cnt;
+};
 /******************************************************************************
 * SECTION: Global Variable
 *******************************************************************************/
 /* reference: https://en.wikipedia.org/wiki/Hard_disk_drive_performance_characteristics */
 struct ddriver disk = {
-    .read_cnt    = 0,
-    .write_cnt   = 0,
-    .seek_cnt    = 0,
+    .head        = 0,
+    .lock        = PTHREAD_MUTEX_INITIALIZER,
+    .backend     = DDRIVER_BACKEND_FILE,
+    .lat_mode    = DDRIVER_LAT_EMULATE,
+    .map         = NULL,
     .read_lat    = 2,       /* 2ms */       
     .write_lat   = 1,       /* 1ms */
     .seek_lat    = 4,       /* 4.17ms per 360 degree */
@@ -92,6 +172,14 @@ struct ddriver disk = {
     .iounit_size = CONFIG_BLOCK_SZ
 };
 
+static struct aio_ctx aio = {
+    .engine    = AIO_ENGINE_NONE,
+    .sched     = DDRIVER_SCHED_NOOP,
+    .lock      = PTHREAD_MUTEX_INITIALIZER,
+    .work_cond = PTHREAD_COND_INITIALIZER,
+    .done_cond = PTHREAD_COND_INITIALIZER
+};
+
 FILE *debugf = NULL;
 /******************************************************************************
 * SECTION: Helper Functions
@@ -104,18 +192,125 @@ int check_valid(size_t size) {
     return 0;
 }
 
-int emulate_rotate(int fd, off_t start, off_t end) {
-    int bytes_per_track = disk.layout_size / disk.track_num;
+int check_valid_iov(const struct iovec *iov, int iovcnt, size_t *total) {
+    int i;
+    if (iovcnt <= 0 || iovcnt > UIO_MAXIOV) {
+        user_alert("iov count %d out of range", iovcnt);
+        return -EINVAL;
+    }
+    *total = 0;
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0 || iov[i].iov_len % CONFIG_BLOCK_SZ != 0) {
+            user_alert("iov[%d] size %ld should align to %d", 
+                       i, iov[i].iov_len, CONFIG_BLOCK_SZ);
+            return -EIO;
+        }
+        *total += iov[i].iov_len;
+    }
+    return 0;
+}
+
+long rotate_lat_us(off_t start, off_t end) {
+    off_t bytes_per_track = disk.layout_size / disk.track_num;
     int lat_per_track = disk.seek_lat;
-    int distance = abs(end - start) % bytes_per_track; 
+    off_t distance = (start > end ? start - end : end - start) % bytes_per_track; 
+
+    if (IS_RAW_LAT(disk)) {
+        return 0;
+    }
+    return (long)(distance * lat_per_track / bytes_per_track) * 1000;
+}
+/**
+ * @brief 确定设备大小：DDRIVER_SIZE优先；未设置时沿用已有镜像的大小(不小于默认值)
+ * DDRIVER_SIZE为字节数，可带一个K/M/G后缀，其后不能再有字符(如"4MB"非法)
+ * 
+ * @param fd 
+ * @return off_t 对齐到扇区的设备大小，非法或溢出时返回-1
+ */
+static off_t parse_disk_size(int fd) {
+    char *env = getenv(ENV_SIZE);
+    char *end;
+    unsigned long long size;
+    int shift = 0;
+    struct stat st;
+
+    if (env == NULL) {
+        if (fstat(fd, &st) == 0 && st.st_size > CONFIG_DISK_SZ) {
+            return ADDR_ROUND_UP(st.st_size);
+        }
+        return CONFIG_DISK_SZ;
+    }
+
+    if (strchr(env, '-') != NULL) {     /* strtoull会把负数转成很大的正数 */
+        return -1;
+    }
+    errno = 0;
+    size = strtoull(env, &end, 0);
+    if (end == env || errno == ERANGE) {
+        return -1;
+    }
+    switch (*end)
+    {
+    case 'G': case 'g':
+        shift = 30;
+        end++;
+        break;
+    case 'M': case 'm':
+        shift = 20;
+        end++;
+        break;
+    case 'K': case 'k':
+        shift = 10;
+        end++;
+        break;
+    default:
+        break;
+    }
+    if (*end != '\0' || size > ((unsigned long long)LLONG_MAX >> shift)) {
+        return -1;
+    }
+    size <<= shift;
+    if (size < CONFIG_BLOCK_SZ || !IS_ADDR_ALIGN(size)) {
+        return -1;
+    }
+    return (off_t)size;
+}
+
+int emulate_rotate(int fd, off_t start, off_t end) {
+    long lat = rotate_lat_us(start, end);
     
-    if (distance == 0) {
+    if (lat == 0) {
         return 0;
     }
 
-    usleep(distance * lat_per_track / bytes_per_track * 1000);
+    usleep(lat);
     return 0;
 }
+
+int log2_bucket(uint64_t val, int nr_buckets) {
+    int bucket = val == 0 ? 0 : 63 - __builtin_clzll(val);
+    return bucket >= nr_buckets ? nr_buckets - 1 : bucket;
+}
+
+void record_seek(off_t start, off_t end) {
+    unsigned long long sectors = (start > end ? start - end : end - start) / CONFIG_BLOCK_SZ;
+    disk.stats.seek_sectors += sectors;
+    disk.stats.seek_hist[log2_bucket(sectors, DDRIVER_SEEK_HIST_BUCKETS)]++;
+}
+
+uint64_t clock_ns(clockid_t clk) {
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+/**
+ * @brief 清零统计并记下清零时刻，调用者持有disk.lock
+ */
+void reset_stats(void) {
+    memset(&disk.stats, 0, sizeof(disk.stats));
+    disk.stats.reset_mono_ns = clock_ns(CLOCK_MONOTONIC);
+    disk.stats.reset_real_ns = clock_ns(CLOCK_REALTIME);
+}
 /******************************************************************************
 * SECTION: Global Function Implementation
 *******************************************************************************/
@@ -126,6 +321,7 @@ int emulate_rotate(int fd, off_t start, off_t end) {
  */
 int ddriver_open(char *path) {
     int fd, ret = 0;
+    char *env;
     char device_path[128] = {0};
     char log_path[128] = {0};
     
@@ -147,10 +343,17 @@ int ddriver_open(char *path) {
         user_panic("can't open device: %d", fd);
         return fd;
     }
-    ret = posix_fallocate(fd, 0, CONFIG_DISK_SZ);
-    if (ret < 0) {
+    disk.layout_size = parse_disk_size(fd);
+    if (disk.layout_size < 0) {
+        user_panic("bad %s [%s], should be sector aligned bytes, K/M/G suffix allowed", ENV_SIZE, getenv(ENV_SIZE));
+        close(fd);
+        return -1;
+    }
+    ret = posix_fallocate(fd, 0, disk.layout_size);
+    if (ret != 0) {
         user_panic("low space");
-        return ret;
+        close(fd);
+        return -ret;
     }
 
     debugf = fopen(log_path, "w+");
@@ -159,6 +362,32 @@ int ddriver_open(char *path) {
         return -1;
     }
 
+    env = getenv(ENV_LATENCY);
+    disk.lat_mode = (env && strcmp(env, "raw") == 0) ? DDRIVER_LAT_RAW 
+                                                     : DDRIVER_LAT_EMULATE;
+    env = getenv(ENV_SCHED);
+    if (env && strcmp(env, "scan") == 0)
+        aio.sched = DDRIVER_SCHED_SCAN;
+    else if (env && strcmp(env, "deadline") == 0)
+        aio.sched = DDRIVER_SCHED_DEADLINE;
+    else if (env && strcmp(env, "noop") == 0)
+        aio.sched = DDRIVER_SCHED_NOOP;
+    env = getenv(ENV_BACKEND);
+    disk.backend = DDRIVER_BACKEND_FILE;
+    disk.map = NULL;
+    if (env && strcmp(env, "mmap") == 0) {
+        disk.map = mmap(NULL, disk.layout_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (disk.map == MAP_FAILED) {
+            user_panic("can't map device: %s", strerror(errno));
+            disk.map = NULL;
+            close(fd);
+            return -1;
+        }
+        disk.backend = DDRIVER_BACKEND_MMAP;
+    }
+
+    disk.head = 0;
+    reset_stats();
     return fd;
 }
 /**
@@ -167,7 +396,15 @@ int ddriver_open(char *path) {
  * @param fd 
  * @return int 
  */
+static void aio_teardown(void);
 int ddriver_close(int fd) {
+    aio_teardown();
+    if (disk.backend == DDRIVER_BACKEND_MMAP && disk.map != NULL) {
+        msync(disk.map, disk.layout_size, MS_SYNC);
+        munmap(disk.map, disk.layout_size);
+        disk.map = NULL;
+        disk.backend = DDRIVER_BACKEND_FILE;
+    }
     return close(fd) && fclose(debugf);
 }
 /**
@@ -176,11 +413,11 @@ int ddriver_close(int fd) {
  * @param fd 
  * @param offset 
  * @param whence 
- * @return int 
+ * @return off_t 磁头新位置
  */
-int ddriver_seek(int fd, off_t offset, int whence){
-    int ret = 0;
-    int cur = 0;
+off_t ddriver_seek(int fd, off_t offset, int whence){
+    off_t target;
+    off_t from;
 
     if (!IS_ADDR_ALIGN(offset)) {
         user_alert("offset %ld must be aligned to block size %d", 
@@ -188,15 +425,218 @@ int ddriver_seek(int fd, off_t offset, int whence){
         return -EINVAL;
     }
 
-    INC_SEEKCNT(disk);
-    cur = lseek(fd, 0, SEEK_CUR);
-    ret = lseek(fd, offset, whence);
-    if (ret < 0) {
-        user_panic("seek error: %s", strerror(errno));
-        return ret;
+    DISK_LOCK(disk);
+    switch (whence)
+    {
+    case SEEK_SET:
+        target = offset;
+        break;
+    case SEEK_CUR:
+        target = disk.head + offset;
+        break;
+    case SEEK_END:
+        target = disk.layout_size + offset;
+        break;
+    default:
+        DISK_UNLOCK(disk);
+        user_alert("unknown whence %d", whence);
+        return -EINVAL;
     }
-    emulate_rotate(fd, cur, ret);
-    return ret;
+    if (target < 0 || target > disk.layout_size) {
+        DISK_UNLOCK(disk);
+        user_alert("seek to %ld out of device", target);
+        return -EINVAL;
+    }
+    from = disk.head;
+    if (target != from) {                             /* 磁头已在目标位置则无需寻道 */
+        INC_SEEKCNT(disk);
+        record_seek(from, target);
+        if (!IS_RAW_LAT(disk))
+            disk.stats.seek_lat_us += rotate_lat_us(from, target);
+        disk.head = target;
+    }
+    DISK_UNLOCK(disk);
+
+    if (target != from) {
+        emulate_rotate(fd, from, target);
+    }
+    return target;
+}
+/**
+ * @brief mmap后端的数据搬运：直接在映射区与iov之间memcpy
+ * 
+ * @param iov 
+ * @param iovcnt 
+ * @param offset 
+ * @param is_write 
+ */
+static void disk_map_copy(const struct iovec *iov, int iovcnt, off_t offset, int is_write){
+    int i;
+    for (i = 0; i < iovcnt; i++) {
+        if (is_write)
+            memcpy(disk.map + offset, iov[i].iov_base, iov[i].iov_len);
+        else
+            memcpy(iov[i].iov_base, disk.map + offset, iov[i].iov_len);
+        offset += iov[i].iov_len;
+    }
+}
+/**
+ * @brief 检查一次定位读写请求：各段按扇区对齐且整个区间落在设备内
+ * 
+ * @param iov 
+ * @param iovcnt 
+ * @param offset 
+ * @param total 返回请求总字节数
+ * @return int 
+ */
+static int disk_check_range(off_t offset, size_t total){
+    if (!IS_ADDR_ALIGN(offset) || offset < 0 || offset + total > disk.layout_size) {
+        user_alert("io [%ld, +%ld) must be aligned to %d and inside device", 
+                   offset, total, CONFIG_BLOCK_SZ);
+        return -EINVAL;
+    }
+    return 0;
+}
+static int disk_check_io(const struct iovec *iov, int iovcnt, off_t offset, size_t *total){
+    int res = check_valid_iov(iov, iovcnt, total);
+    if(res < 0)
+        return res;
+    return disk_check_range(offset, *total);
+}
+/**
+ * @brief 一次请求的记账：移动磁头，记录寻道、读写次数、字节数与模拟延迟。
+ * 调用者持有disk.lock
+ * 
+ * @param offset 
+ * @param total 
+ * @param is_write 
+ * @return off_t 请求前磁头位置，用于计算寻道延迟
+ */
+static off_t disk_account_locked(off_t offset, size_t total, int is_write){
+    uint64_t lat_us = 0, seek_us = 0;
+    off_t from;
+
+    from = disk.head;
+    if (!IS_RAW_LAT(disk)) {                          /* 寻道只计入seek_lat_us，与ddriver_seek一致 */
+        if (offset != from)
+            seek_us = rotate_lat_us(from, offset);
+        lat_us = 1000ULL * (is_write ? disk.write_lat : disk.read_lat);
+    }
+    if (offset != from) {
+        INC_SEEKCNT(disk);
+        record_seek(from, offset);
+        disk.stats.seek_lat_us += seek_us;
+    }
+    disk.head = offset + total;
+    if (is_write) {
+        INC_WRITECNT(disk);
+        disk.stats.write_bytes += total;
+        disk.stats.write_lat_us += lat_us;
+        disk.stats.write_lat_hist[log2_bucket(lat_us, DDRIVER_LAT_HIST_BUCKETS)]++;
+    }
+    else {
+        INC_READCNT(disk);
+        disk.stats.read_bytes += total;
+        disk.stats.read_lat_us += lat_us;
+        disk.stats.read_lat_hist[log2_bucket(lat_us, DDRIVER_LAT_HIST_BUCKETS)]++;
+    }
+    return from;
+}
+/**
+ * @brief 一次请求的记账，只在记账时持锁，延迟与IO可并发
+ * 
+ * @param offset 
+ * @param total 
+ * @param is_write 
+ * @return off_t 请求前磁头位置
+ */
+static off_t disk_account(off_t offset, size_t total, int is_write){
+    off_t from;
+
+    DISK_LOCK(disk);
+    from = disk_account_locked(offset, total, is_write);
+    DISK_UNLOCK(disk);
+    return from;
+}
+/**
+ * @brief 模拟一次已记账请求的寻道与读写延迟
+ * 
+ * @param fd 
+ * @param offset 
+ * @param from 记账前的磁头位置
+ * @param is_write 
+ */
+static void disk_delay(int fd, off_t offset, off_t from, int is_write){
+    if (offset != from) {
+        emulate_rotate(fd, from, offset);
+    }
+    if (is_write)
+        RW_DELAY(disk, write);
+    else
+        RW_DELAY(disk, read);
+}
+/**
+ * @brief 服务一次已记账的请求：计寻道与读写延迟，再用pread/pwrite访问镜像，
+ * 不依赖文件描述符上的共享偏移；mmap后端下改为memcpy
+ * 
+ * @param fd 
+ * @param iov 
+ * @param iovcnt 
+ * @param offset 
+ * @param total 
+ * @param from 记账前的磁头位置
+ * @param is_write 
+ * @return int 读写的字节数
+ */
+static int disk_service(int fd, const struct iovec *iov, int iovcnt, off_t offset, 
+                        size_t total, off_t from, int is_write){
+    ssize_t ret;
+
+    disk_delay(fd, offset, from, is_write);
+    if (disk.backend == DDRIVER_BACKEND_MMAP) {
+        disk_map_copy(iov, iovcnt, offset, is_write);
+        return total;
+    }
+    if (is_write)
+        ret = pwritev(fd, iov, iovcnt, offset);
+    else
+        ret = preadv(fd, iov, iovcnt, offset);
+    if (ret != (ssize_t)total) {
+        user_panic("%s error at %ld: %s", is_write ? "pwritev" : "preadv", 
+                   offset, strerror(errno));
+        return -EIO;
+    }
+    return total;
+}
+/**
+ * @brief 读写的公共实现：检查、记账后立即服务。offset为DISK_AT_HEAD时
+ * 从共享磁头处读写，磁头位置与记账在同一次持锁内读取和更新
+ * 
+ * @param fd 
+ * @param iov 每段长度须为CONFIG_BLOCK_SZ的整数倍
+ * @param iovcnt 
+ * @param offset 须对齐到CONFIG_BLOCK_SZ，或为DISK_AT_HEAD
+ * @param is_write 
+ * @return int 读写的字节数
+ */
+static int disk_prw(int fd, const struct iovec *iov, int iovcnt, off_t offset, int is_write){
+    size_t total;
+    off_t from;
+    int res = check_valid_iov(iov, iovcnt, &total);
+    if(res < 0)
+        return res;
+
+    DISK_LOCK(disk);
+    if (offset == DISK_AT_HEAD)
+        offset = disk.head;
+    res = disk_check_range(offset, total);
+    if (res < 0) {
+        DISK_UNLOCK(disk);
+        return res;
+    }
+    from = disk_account_locked(offset, total, is_write);
+    DISK_UNLOCK(disk);
+    return disk_service(fd, iov, iovcnt, offset, total, from, is_write);
 }
 /**
  * @brief 磁盘写入，写入大小可通过IOCTL查询
@@ -208,14 +648,10 @@ int ddriver_seek(int fd, off_t offset, int whence){
  */
 int ddriver_write(int fd, char *buf, size_t size){
     int res = check_valid(size);
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
     if(res < 0)
         return res;
-        
-    RW_DELAY(disk, write);
-    write(fd, buf, size);
-
-    INC_WRITECNT(disk);
-    return CONFIG_BLOCK_SZ;
+    return disk_prw(fd, &iov, 1, DISK_AT_HEAD, 1);
 }
 /**
  * @brief 
@@ -227,14 +663,755 @@ int ddriver_write(int fd, char *buf, size_t size){
  */
 int ddriver_read(int fd, char *buf, size_t size){
     int res = check_valid(size);
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+    if(res < 0)
+        return res;
+    return disk_prw(fd, &iov, 1, DISK_AT_HEAD, 0);
+}
+/**
+ * @brief 向量写入，一次请求写入磁头处若干连续扇区，只计一次写延迟
+ * 
+ * @param fd 
+ * @param iov 每段长度须为CONFIG_BLOCK_SZ的整数倍
+ * @param iovcnt 
+ * @return int 写入的字节数
+ */
+int ddriver_writev(int fd, const struct iovec *iov, int iovcnt){
+    return disk_prw(fd, iov, iovcnt, DISK_AT_HEAD, 1);
+}
+/**
+ * @brief 向量读出，一次请求读出磁头处若干连续扇区，只计一次读延迟
+ * 
+ * @param fd 
+ * @param iov 每段长度须为CONFIG_BLOCK_SZ的整数倍
+ * @param iovcnt 
+ * @return int 读出的字节数
+ */
+int ddriver_readv(int fd, const struct iovec *iov, int iovcnt){
+    return disk_prw(fd, iov, iovcnt, DISK_AT_HEAD, 0);
+}
+/**
+ * @brief 多扇区写入，size须为CONFIG_BLOCK_SZ的整数倍
+ * 
+ * @param fd 
+ * @param buf 
+ * @param size 
+ * @return int 写入的字节数
+ */
+int ddriver_writen(int fd, char *buf, size_t size){
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+    return ddriver_writev(fd, &iov, 1);
+}
+/**
+ * @brief 多扇区读出，size须为CONFIG_BLOCK_SZ的整数倍
+ * 
+ * @param fd 
+ * @param buf 
+ * @param size 
+ * @return int 读出的字节数
+ */
+int ddriver_readn(int fd, char *buf, size_t size){
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+    return ddriver_readv(fd, &iov, 1);
+}
+/**
+ * @brief 定位向量写入，从offset处写入，不依赖共享的磁头位置，可多线程并发调用。
+ * 与真实磁盘一样，磁头随之移到写入结束处，之后的寻道从这里算起
+ * 
+ * @param fd 
+ * @param iov 每段长度须为CONFIG_BLOCK_SZ的整数倍
+ * @param iovcnt 
+ * @param offset 须对齐到CONFIG_BLOCK_SZ
+ * @return int 写入的字节数
+ */
+int ddriver_pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset){
+    if (offset < 0)                                   /* 负偏移不得被当作DISK_AT_HEAD */
+        return disk_check_range(offset, 0);
+    return disk_prw(fd, iov, iovcnt, offset, 1);
+}
+/**
+ * @brief 定位向量读出，从offset处读出，可多线程并发调用；磁头同样移到读出结束处
+ * 
+ * @param fd 
+ * @param iov 每段长度须为CONFIG_BLOCK_SZ的整数倍
+ * @param iovcnt 
+ * @param offset 须对齐到CONFIG_BLOCK_SZ
+ * @return int 读出的字节数
+ */
+int ddriver_preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset){
+    if (offset < 0)                                   /* 负偏移不得被当作DISK_AT_HEAD */
+        return disk_check_range(offset, 0);
+    return disk_prw(fd, iov, iovcnt, offset, 0);
+}
+/**
+ * @brief 定位写入，size须为CONFIG_BLOCK_SZ的整数倍
+ * 
+ * @param fd 
+ * @param buf 
+ * @param size 
+ * @param offset 须对齐到CONFIG_BLOCK_SZ
+ * @return int 写入的字节数
+ */
+int ddriver_pwrite(int fd, char *buf, size_t size, off_t offset){
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+    return ddriver_pwritev(fd, &iov, 1, offset);
+}
+/**
+ * @brief 定位读出，size须为CONFIG_BLOCK_SZ的整数倍
+ * 
+ * @param fd 
+ * @param buf 
+ * @param size 
+ * @param offset 须对齐到CONFIG_BLOCK_SZ
+ * @return int 读出的字节数
+ */
+int ddriver_pread(int fd, char *buf, size_t size, off_t offset){
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+    return ddriver_preadv(fd, &iov, 1, offset);
+}
+/**
+ * @brief 为调用者直接在镜像文件上完成的一次传输(如FUSE在管道与文件间splice)
+ * 做检查、记账与延迟模拟，本身不搬运数据。mmap后端为MAP_SHARED映射，
+ * 经文件描述符的读写与映射区一致
+ * 
+ * @param fd 
+ * @param offset 须对齐到CONFIG_BLOCK_SZ
+ * @param size 须为CONFIG_BLOCK_SZ的整数倍
+ * @param is_write 
+ * @return int 可用于该传输的镜像文件描述符，失败返回负的错误码
+ */
+int ddriver_splice(int fd, off_t offset, size_t size, int is_write){
+    struct iovec iov = { .iov_base = NULL, .iov_len = size };
+    size_t total;
+    off_t from;
+    int res = disk_check_io(&iov, 1, offset, &total);
     if(res < 0)
         return res;
 
-    RW_DELAY(disk, read);
-    read(fd, buf, size);
+    from = disk_account(offset, total, is_write);
+    disk_delay(fd, offset, from, is_write);
+    return fd;
+}
+/******************************************************************************
+* SECTION: Async IO (io_uring, thread pool fallback)
+*******************************************************************************/
+/**
+ * @brief 取一个空闲的请求槽，调用者保证aio.free_cnt > 0
+ * 
+ * @return int 槽下标
+ */
+static int aio_get_slot(void) {
+    return aio.free_stack[--aio.free_cnt];
+}
+
+static void aio_put_slot(int idx) {
+    aio.slot[idx].req = NULL;
+    aio.free_stack[aio.free_cnt++] = idx;
+}
+
+static void ts_add_us(struct timespec *ts, long us) {
+    long nsec = ts->tv_nsec + (us % 1000000) * 1000;
+    ts->tv_sec += us / 1000000 + nsec / 1000000000;
+    ts->tv_nsec = nsec % 1000000000;
+}
+
+static int ts_before(const struct timespec *a, const struct timespec *b) {
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+/**
+ * @brief 完成一次设备IO：等到其模拟延迟到期，再把结果拆回合并进来的每个请求，
+ * 放入待reap队列
+ * 
+ * @param idx IO的首个请求槽
+ * @param res 整个IO读写的字节数或-errno
+ */
+static void aio_complete(int idx, int res) {
+    struct aio_slot *head = &aio.slot[idx];
+    struct aio_slot *slot;
+    int next;
+
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &head->deadline, NULL);
+    if (res >= 0 && res != (int)head->io_total) {
+        res = -EIO;
+    }
+    if (head->merged_iov != NULL) {
+        free(head->merged_iov);
+        head->merged_iov = NULL;
+    }
+    for (; idx >= 0; idx = next) {
+        slot = &aio.slot[idx];
+        next = slot->merge_next;
+        slot->req->res = res < 0 ? res : (int)slot->total;
+        aio.ready[(aio.ready_head + aio.ready_cnt) % DDRIVER_QUEUE_DEPTH] = idx;
+        aio.ready_cnt++;
+    }
+}
+
+static int aio_uring_setup(void) {
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    aio.ring_fd = syscall(__NR_io_uring_setup, DDRIVER_QUEUE_DEPTH, &p);
+    if (aio.ring_fd < 0) {
+        return -errno;
+    }
+
+    aio.sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    aio.cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        aio.sq_sz = aio.cq_sz = aio.sq_sz > aio.cq_sz ? aio.sq_sz : aio.cq_sz;
+    }
+    aio.sq_ptr = mmap(NULL, aio.sq_sz, PROT_READ | PROT_WRITE, 
+                      MAP_SHARED | MAP_POPULATE, aio.ring_fd, IORING_OFF_SQ_RING);
+    if (aio.sq_ptr == MAP_FAILED) {
+        close(aio.ring_fd);
+        return -ENOMEM;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        aio.cq_ptr = aio.sq_ptr;
+    }
+    else {
+        aio.cq_ptr = mmap(NULL, aio.cq_sz, PROT_READ | PROT_WRITE, 
+                          MAP_SHARED | MAP_POPULATE, aio.ring_fd, IORING_OFF_CQ_RING);
+        if (aio.cq_ptr == MAP_FAILED) {
+            munmap(aio.sq_ptr, aio.sq_sz);
+            close(aio.ring_fd);
+            return -ENOMEM;
+        }
+    }
+    aio.sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    aio.sqes = mmap(NULL, aio.sqes_sz, PROT_READ | PROT_WRITE, 
+                    MAP_SHARED | MAP_POPULATE, aio.ring_fd, IORING_OFF_SQES);
+    if (aio.sqes == MAP_FAILED) {
+        if (aio.cq_ptr != aio.sq_ptr)
+            munmap(aio.cq_ptr, aio.cq_sz);
+        munmap(aio.sq_ptr, aio.sq_sz);
+        close(aio.ring_fd);
+        return -ENOMEM;
+    }
+
+    aio.sq_head  = (unsigned *)((char *)aio.sq_ptr + p.sq_off.head);
+    aio.sq_tail  = (unsigned *)((char *)aio.sq_ptr + p.sq_off.tail);
+    aio.sq_mask  = (unsigned *)((char *)aio.sq_ptr + p.sq_off.ring_mask);
+    aio.sq_array = (unsigned *)((char *)aio.sq_ptr + p.sq_off.array);
+    aio.cq_head  = (unsigned *)((char *)aio.cq_ptr + p.cq_off.head);
+    aio.cq_tail  = (unsigned *)((char *)aio.cq_ptr + p.cq_off.tail);
+    aio.cq_mask  = (unsigned *)((char *)aio.cq_ptr + p.cq_off.ring_mask);
+    aio.cqes     = (struct io_uring_cqe *)((char *)aio.cq_ptr + p.cq_off.cqes);
+    return 0;
+}
+
+static void aio_uring_queue(int idx) {
+    struct aio_slot *slot = &aio.slot[idx];
+    unsigned tail = *aio.sq_tail;
+    unsigned i = tail & *aio.sq_mask;
+    struct io_uring_sqe *sqe = &aio.sqes[i];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = slot->is_write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd        = aio.fd;
+    sqe->addr      = (unsigned long)slot->io_iov;
+    sqe->len       = slot->io_iovcnt;
+    sqe->off       = slot->req->offset;
+    sqe->user_data = idx;
+    aio.sq_array[i] = i;
+    __atomic_store_n(aio.sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static int aio_uring_enter(int to_submit, int min_complete) {
+    int ret;
+    do {
+        ret = syscall(__NR_io_uring_enter, aio.ring_fd, to_submit, min_complete, 
+                      min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret < 0 ? -errno : ret;
+}
+/**
+ * @brief 收取io_uring上已完成的IO，没有时至少等待一个
+ * 
+ * @return int 
+ */
+static int aio_uring_harvest(void) {
+    struct io_uring_cqe *cqe;
+    unsigned head, tail;
+    int ret;
+
+    head = *aio.cq_head;
+    tail = __atomic_load_n(aio.cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        ret = aio_uring_enter(0, 1);
+        if (ret < 0) {
+            return ret;
+        }
+        tail = __atomic_load_n(aio.cq_tail, __ATOMIC_ACQUIRE);
+    }
+    while (head != tail) {
+        cqe = &aio.cqes[head & *aio.cq_mask];
+        aio_complete((int)cqe->user_data, cqe->res);
+        head++;
+    }
+    __atomic_store_n(aio.cq_head, head, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * @brief 把SQ中排好的IO交给内核，直到全部被取走；出错时撤回内核未取走的SQE，
+ * 这些IO以错误完成，由reap照常取回
+ * 
+ * @param to_submit 排入SQ的IO数
+ * @return int 全部提交返回0，否则返回错误码
+ */
+static int aio_uring_submit(int to_submit) {
+    struct io_uring_sqe *sqe;
+    unsigned head, tail;
+    int ret = 0;
+
+    while (to_submit > 0) {
+        ret = aio_uring_enter(to_submit, 0);
+        if (ret <= 0) {
+            ret = ret < 0 ? ret : -EAGAIN;
+            break;
+        }
+        to_submit -= ret;
+    }
+    if (to_submit == 0) {
+        return 0;
+    }
+    head = __atomic_load_n(aio.sq_head, __ATOMIC_ACQUIRE);
+    tail = *aio.sq_tail;
+    __atomic_store_n(aio.sq_tail, head, __ATOMIC_RELEASE);
+    for (; head != tail; head++) {
+        sqe = &aio.sqes[aio.sq_array[head & *aio.sq_mask]];
+        aio_complete((int)sqe->user_data, ret);
+    }
+    return ret;
+}
+
+static void *aio_worker(void *arg) {
+    struct aio_slot *slot;
+    int idx, res;
+
+    IGNORE_ARG(arg);
+    pthread_mutex_lock(&aio.lock);
+    while (1) {
+        while (!aio.stop && aio.pend_cnt == 0) {
+            pthread_cond_wait(&aio.work_cond, &aio.lock);
+        }
+        if (aio.pend_cnt == 0) {                      /* 停止时先做完已派发的IO */
+            break;
+        }
+        idx = aio.pend[aio.pend_head];
+        aio.pend_head = (aio.pend_head + 1) % DDRIVER_QUEUE_DEPTH;
+        aio.pend_cnt--;
+        pthread_mutex_unlock(&aio.lock);
+
+        slot = &aio.slot[idx];                        /* 派发时已记账，这里只计延迟并做IO */
+        res = disk_service(aio.fd, slot->io_iov, slot->io_iovcnt, slot->req->offset, 
+                           slot->io_total, slot->from, slot->is_write);
+
+        pthread_mutex_lock(&aio.lock);
+        slot->res = res;
+        aio.done[(aio.done_head + aio.done_cnt) % DDRIVER_QUEUE_DEPTH] = idx;
+        aio.done_cnt++;
+        pthread_cond_signal(&aio.done_cond);
+    }
+    pthread_mutex_unlock(&aio.lock);
+    return NULL;
+}
+
+static int aio_pool_setup(void) {
+    int i;
+
+    aio.stop = 0;
+    aio.pend_head = aio.pend_cnt = 0;
+    aio.done_head = aio.done_cnt = 0;
+    for (i = 0; i < AIO_POOL_THREADS; i++) {
+        if (pthread_create(&aio.workers[i], NULL, aio_worker, NULL) != 0) {
+            break;
+        }
+    }
+    aio.nr_workers = i;
+    return i > 0 ? 0 : -EAGAIN;
+}
+/**
+ * @brief 收取线程池已完成的IO，没有时至少等待一个
+ * 
+ * @return int 
+ */
+static int aio_pool_harvest(void) {
+    int idx;
+
+    pthread_mutex_lock(&aio.lock);
+    while (aio.done_cnt == 0) {
+        pthread_cond_wait(&aio.done_cond, &aio.lock);
+    }
+    while (aio.done_cnt > 0) {
+        idx = aio.done[aio.done_head];
+        aio.done_head = (aio.done_head + 1) % DDRIVER_QUEUE_DEPTH;
+        aio.done_cnt--;
+        aio_complete(idx, aio.slot[idx].res);
+    }
+    pthread_mutex_unlock(&aio.lock);
+    return 0;
+}
+/******************************************************************************
+* SECTION: IO scheduler
+*******************************************************************************/
+static int sched_cmp_offset(const void *a, const void *b) {
+    off_t oa = aio.slot[*(const int *)a].req->offset;
+    off_t ob = aio.slot[*(const int *)b].req->offset;
+    return oa < ob ? -1 : (oa > ob ? 1 : 0);
+}
+/**
+ * @brief 电梯序(单向C-SCAN)：按偏移排序后，先服务磁头之后的请求，再回到最低处继续升序服务，
+ * 始终升序使扇区相接的请求都能向后合并
+ * 
+ * @param order 
+ * @param cnt 
+ */
+static void sched_scan(int *order, int cnt) {
+    int sorted[DDRIVER_QUEUE_DEPTH];
+    off_t head;
+    int i, split, n = 0;
+
+    memcpy(sorted, order, cnt * sizeof(int));
+    qsort(sorted, cnt, sizeof(int), sched_cmp_offset);
+    DISK_LOCK(disk);
+    head = disk.head;
+    DISK_UNLOCK(disk);
+    for (split = 0; split < cnt && aio.slot[sorted[split]].req->offset < head; split++)
+        ;
+    for (i = split; i < cnt; i++)
+        order[n++] = sorted[i];
+    for (i = 0; i < split; i++)
+        order[n++] = sorted[i];
+}
+/**
+ * @brief 截止期序：已超过截止期的请求按到达顺序优先，其余按电梯序
+ * 
+ * @param order 
+ * @param cnt 
+ */
+static void sched_deadline(int *order, int cnt) {
+    int expired[DDRIVER_QUEUE_DEPTH];
+    int rest[DDRIVER_QUEUE_DEPTH];
+    struct timespec now;
+    int i, n_exp = 0, n_rest = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (i = 0; i < cnt; i++) {
+        if (ts_before(&aio.slot[order[i]].expire, &now))
+            expired[n_exp++] = order[i];
+        else
+            rest[n_rest++] = order[i];
+    }
+    sched_scan(rest, n_rest);
+    memcpy(order, expired, n_exp * sizeof(int));
+    memcpy(order + n_exp, rest, n_rest * sizeof(int));
+}
+/**
+ * @brief 能否把请求b接在IO a之后合并：同为读或写、扇区相接、合并后iov不超限
+ * 
+ * @param a IO的首个请求槽
+ * @param b 
+ * @return int 
+ */
+static int sched_can_merge(struct aio_slot *a, struct aio_slot *b) {
+    return a->is_write == b->is_write && 
+           a->req->offset + (off_t)a->io_total == b->req->offset &&
+           a->io_iovcnt + b->req->iovcnt <= UIO_MAXIOV;
+}
+/**
+ * @brief 派发一次设备IO：按派发顺序记账(磁头移动与寻道)，再交给io_uring或线程池
+ * 
+ * @param idx IO的首个请求槽
+ * @param now 
+ */
+static void sched_issue(int idx, const struct timespec *now) {
+    struct aio_slot *slot = &aio.slot[idx];
+    long lat_us = 0;
+
+    slot->from = disk_account(slot->req->offset, slot->io_total, slot->is_write);
+    slot->deadline = *now;
+    if (aio.engine == AIO_ENGINE_URING) {
+        /* io_uring只做真实IO，模拟延迟记为到期时刻，reap时等待，多个IO的延迟因而重叠 */
+        if (!IS_RAW_LAT(disk)) {
+            lat_us = 1000L * (slot->is_write ? disk.write_lat : disk.read_lat);
+            if (slot->req->offset != slot->from)
+                lat_us += rotate_lat_us(slot->from, slot->req->offset);
+        }
+        ts_add_us(&slot->deadline, lat_us);
+        aio_uring_queue(idx);
+    }
+    else {
+        pthread_mutex_lock(&aio.lock);
+        aio.pend[(aio.pend_head + aio.pend_cnt) % DDRIVER_QUEUE_DEPTH] = idx;
+        aio.pend_cnt++;
+        pthread_cond_signal(&aio.work_cond);
+        pthread_mutex_unlock(&aio.lock);
+    }
+}
+/**
+ * @brief 派发一个可能合并过的IO：合并过的IO先拼出一份iov，内存不足时放弃合并，
+ * 链上的请求各自派发
+ * 
+ * @param head_idx IO的首个请求槽
+ * @param now 
+ * @return int 派发的设备IO数
+ */
+static int sched_issue_merged(int head_idx, const struct timespec *now) {
+    struct aio_slot *head = &aio.slot[head_idx];
+    struct aio_slot *slot;
+    int n = 0, j, k, next;
+
+    if (head->merge_next < 0) {
+        sched_issue(head_idx, now);
+        return 1;
+    }
+    head->merged_iov = malloc(head->io_iovcnt * sizeof(struct iovec));
+    if (head->merged_iov != NULL) {
+        for (j = head_idx; j >= 0; j = aio.slot[j].merge_next)
+            for (k = 0; k < aio.slot[j].req->iovcnt; k++)
+                head->merged_iov[n++] = aio.slot[j].req->iov[k];
+        head->io_iov = head->merged_iov;
+        sched_issue(head_idx, now);
+        return 1;
+    }
+    for (j = head_idx; j >= 0; j = next) {
+        slot = &aio.slot[j];
+        next = slot->merge_next;
+        slot->merge_next = -1;
+        slot->io_iov = slot->req->iov;
+        slot->io_iovcnt = slot->req->iovcnt;
+        slot->io_total = slot->total;
+        if (j != head_idx)
+            aio.merge_cnt--;
+        sched_issue(j, now);
+        n++;
+    }
+    return n;
+}
+/**
+ * @brief 泄流：按调度策略排序暂存的请求，合并扇区相接的同向请求，再全部派发
+ * 
+ * @return int 
+ */
+static int sched_unplug(void) {
+    int order[DDRIVER_QUEUE_DEPTH];
+    struct aio_slot *head = NULL, *slot, *tail = NULL;
+    struct timespec now;
+    int cnt = aio.queued_cnt, issued = 0, head_idx = -1, i, ret;
+
+    if (cnt == 0) {
+        return 0;
+    }
+    memcpy(order, aio.queued, cnt * sizeof(int));
+    aio.queued_cnt = 0;
+    if (aio.sched == DDRIVER_SCHED_SCAN)
+        sched_scan(order, cnt);
+    else if (aio.sched == DDRIVER_SCHED_DEADLINE)
+        sched_deadline(order, cnt);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (i = 0; i <= cnt; i++) {
+        slot = i < cnt ? &aio.slot[order[i]] : NULL;
+        if (head != NULL && slot != NULL && sched_can_merge(head, slot)) {
+            tail->merge_next = order[i];
+            slot->merge_next = -1;
+            head->io_total += slot->total;
+            head->io_iovcnt += slot->req->iovcnt;
+            aio.merge_cnt++;
+            tail = slot;
+            continue;
+        }
+        if (head != NULL) {
+            issued += sched_issue_merged(head_idx, &now);
+        }
+        if (slot != NULL) {
+            head_idx = order[i];
+            head = tail = slot;
+            head->merge_next = -1;
+            head->merged_iov = NULL;
+            head->io_iov = slot->req->iov;
+            head->io_iovcnt = slot->req->iovcnt;
+            head->io_total = slot->total;
+        }
+    }
+
+    if (aio.engine == AIO_ENGINE_URING) {
+        ret = aio_uring_submit(issued);
+        if (ret < 0) {                                /* 未提交的IO已以错误完成，仍由reap取回 */
+            user_alert("io_uring_enter: %s", strerror(-ret));
+        }
+    }
+    return 0;
+}
+/**
+ * @brief 首次提交时初始化异步队列：优先io_uring，不可用时(或DDRIVER_AIO=pool)退回线程池
+ * 
+ * @param fd 
+ * @return int 
+ */
+static int aio_setup(int fd) {
+    char *env = getenv(ENV_AIO);
+    int i;
+
+    aio.fd = fd;
+    aio.inflight = 0;
+    aio.free_cnt = 0;
+    aio.queued_cnt = 0;
+    aio.ready_head = aio.ready_cnt = 0;
+    for (i = DDRIVER_QUEUE_DEPTH - 1; i >= 0; i--) {
+        aio_put_slot(i);
+    }
+    if (!(env && strcmp(env, "pool") == 0) && aio_uring_setup() == 0) {
+        aio.engine = AIO_ENGINE_URING;
+        return 0;
+    }
+    if (aio_pool_setup() == 0) {
+        aio.engine = AIO_ENGINE_POOL;
+        return 0;
+    }
+    user_alert("no async engine available");
+    return -EAGAIN;
+}
+
+/**
+ * @brief 关闭前排空异步队列：暂存的请求先派发，再等在途IO全部完成，
+ * 之后才停止线程池或解除io_uring映射，已提交的写不会丢失。
+ * 完成的请求不再需要reap，结果照常记在各请求的res中
+ * 
+ */
+static void aio_teardown(void) {
+    int i, ret = 0;
+
+    if (aio.engine == AIO_ENGINE_NONE) {
+        return;
+    }
+    sched_unplug();
+    while (aio.ready_cnt < aio.inflight && ret >= 0) {
+        if (aio.engine == AIO_ENGINE_URING)
+            ret = aio_uring_harvest();
+        else
+            ret = aio_pool_harvest();
+    }
+    aio.inflight = 0;
+    aio.ready_cnt = 0;
+
+    if (aio.engine == AIO_ENGINE_URING) {
+        munmap(aio.sqes, aio.sqes_sz);
+        if (aio.cq_ptr != aio.sq_ptr)
+            munmap(aio.cq_ptr, aio.cq_sz);
+        munmap(aio.sq_ptr, aio.sq_sz);
+        close(aio.ring_fd);
+    }
+    else if (aio.engine == AIO_ENGINE_POOL) {
+        pthread_mutex_lock(&aio.lock);
+        aio.stop = 1;
+        pthread_cond_broadcast(&aio.work_cond);
+        pthread_mutex_unlock(&aio.lock);
+        for (i = 0; i < aio.nr_workers; i++) {
+            pthread_join(aio.workers[i], NULL);
+        }
+    }
+    aio.engine = AIO_ENGINE_NONE;
+}
+/**
+ * @brief 异步提交一批读写请求，不等待完成；完成结果由ddriver_reap取回。
+ * 请求先暂存在调度队列中，reap或队列满时才按调度策略排序、合并后派发。
+ * 同一时刻只应有一个线程调用ddriver_submit/ddriver_reap
+ * 
+ * @param fd 
+ * @param reqs 请求数组，在被reap之前请求及其iov、缓冲区须保持有效
+ * @param nr 
+ * @return int 实际提交的请求数(队列满或遇到非法请求时少于nr)，首个请求即非法时返回-errno
+ */
+int ddriver_submit(int fd, struct ddriver_req *reqs, int nr) {
+    struct ddriver_req *req;
+    struct aio_slot *slot;
+    struct timespec now;
+    size_t total;
+    int i, idx, res = 0;
+
+    if (aio.engine == AIO_ENGINE_NONE && (res = aio_setup(fd)) < 0) {
+        return res;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (i = 0; i < nr && aio.free_cnt > 0; i++) {
+        req = &reqs[i];
+        res = disk_check_io(req->iov, req->iovcnt, req->offset, &total);
+        if (res < 0) {
+            break;
+        }
+        idx = aio_get_slot();
+        slot = &aio.slot[idx];
+        slot->req = req;
+        slot->total = total;
+        slot->is_write = req->op == DDRIVER_OP_WRITE;
+        slot->expire = now;
+        ts_add_us(&slot->expire, 1000L * (slot->is_write ? SCHED_WRITE_EXPIRE_MS 
+                                                         : SCHED_READ_EXPIRE_MS));
+        aio.queued[aio.queued_cnt++] = idx;
+    }
+    if (i == 0) {
+        return res < 0 ? res : -EAGAIN;
+    }
+    aio.inflight += i;
+
+    if (aio.free_cnt == 0) {                          /* 队列已满，不再等待更多请求 */
+        res = sched_unplug();
+        if (res < 0) {
+            return res;
+        }
+    }
+    return i;
+}
+/**
+ * @brief 取回已完成的异步请求，至少等到min_nr个完成；暂存的请求在此派发
+ * 
+ * @param fd 
+ * @param done 返回已完成请求的指针，结果在各自的res中
+ * @param min_nr 超过在途请求数时按在途请求数计
+ * @param max_nr 
+ * @return int 取回的请求数
+ */
+int ddriver_reap(int fd, struct ddriver_req **done, int min_nr, int max_nr) {
+    int n = 0, idx, ret;
+
+    IGNORE_ARG(fd);
+    if (aio.engine == AIO_ENGINE_NONE || aio.inflight == 0) {
+        return 0;
+    }
+    ret = sched_unplug();
+    if (ret < 0) {
+        return ret;
+    }
+    if (min_nr > aio.inflight) {
+        min_nr = aio.inflight;
+    }
+    if (min_nr > max_nr) {
+        min_nr = max_nr;
+    }
 
-    INC_READCNT(disk);
-    return CONFIG_BLOCK_SZ;
+    while (aio.ready_cnt < min_nr) {
+        if (aio.engine == AIO_ENGINE_URING)
+            ret = aio_uring_harvest();
+        else
+            ret = aio_pool_harvest();
+        if (ret < 0) {
+            break;
+        }
+    }
+    while (aio.ready_cnt > 0 && n < max_nr) {
+        idx = aio.ready[aio.ready_head];
+        aio.ready_head = (aio.ready_head + 1) % DDRIVER_QUEUE_DEPTH;
+        aio.ready_cnt--;
+        done[n++] = aio.slot[idx].req;
+        aio_put_slot(idx);
+    }
+    aio.inflight -= n;
+    return n > 0 ? n : ret;
 }
 /**
  * @brief 
@@ -246,32 +1423,83 @@ int ddriver_read(int fd, char *buf, size_t size){
  */
 int ddriver_ioctl(int fd, unsigned long cmd, void *arg){
     struct ddriver_state state;
+    struct ddriver_seek_hist hist;
+    uint64_t size64;
+    int size, i;
     switch (cmd)
     {
     case IOC_REQ_DEVICE_SIZE:                         /* Device Size */
-        memcpy(arg, &disk.layout_size, sizeof(int));
+        /* 超出int时截到扇区整数倍，完整大小用IOC_REQ_DEVICE_SIZE64 */
+        size = disk.layout_size > INT_MAX ? (INT_MAX & ~(CONFIG_BLOCK_SZ - 1)) : disk.layout_size;
+        memcpy(arg, &size, sizeof(int));
+        break;
+    case IOC_REQ_DEVICE_SCHED:                        /* Select IO Scheduler */
+        if (*(int *)arg != DDRIVER_SCHED_NOOP && *(int *)arg != DDRIVER_SCHED_SCAN &&
+            *(int *)arg != DDRIVER_SCHED_DEADLINE) {
+            return -EINVAL;
+        }
+        aio.sched = *(int *)arg;
+        break;
+    case IOC_REQ_DEVICE_SIZE64:                       /* Device Size, 64-bit */
+        size64 = disk.layout_size;
+        memcpy(arg, &size64, sizeof(uint64_t));
         break;
     case IOC_REQ_DEVICE_STATE:                        /* Device State */
-        state.read_cnt = disk.read_cnt;
-        state.write_cnt = disk.write_cnt;
-        state.seek_cnt = disk.seek_cnt;
+        DISK_LOCK(disk);
+        state.read_cnt = disk.stats.read_cnt;
+        state.write_cnt = disk.stats.write_cnt;
+        state.seek_cnt = disk.stats.seek_cnt;
+        DISK_UNLOCK(disk);
         memcpy(arg, &state, sizeof(struct ddriver_state));
         break;
+    case IOC_REQ_DEVICE_SEEK_HIST:                    /* Seek Distance Histogram */
+        DISK_LOCK(disk);
+        for (i = 0; i < DDRIVER_SEEK_HIST_BUCKETS; i++)
+            hist.bucket[i] = disk.stats.seek_hist[i];
+        DISK_UNLOCK(disk);
+        memcpy(arg, &hist, sizeof(struct ddriver_seek_hist));
+        break;
+    case IOC_REQ_DEVICE_STATS:                        /* Detailed Statistics */
+        DISK_LOCK(disk);
+        disk.stats.now_mono_ns = clock_ns(CLOCK_MONOTONIC);
+        memcpy(arg, &disk.stats, sizeof(struct ddriver_stats));
+        DISK_UNLOCK(disk);
+        break;
+    case IOC_REQ_DEVICE_STATS_RESET:                  /* Reset Statistics Only */
+        DISK_LOCK(disk);
+        reset_stats();
+        DISK_UNLOCK(disk);
+        break;
     case IOC_REQ_DEVICE_RESET:                        /* Reset Device */
-        lseek(fd, 0, SEEK_SET);
-        char buf[4096] = {'\0'};
-        for (size_t i = 0; i < CONFIG_DISK_SZ; i += 4096)
-        {
-            write(fd, buf, 4096);
+        if (disk.backend == DDRIVER_BACKEND_MMAP) {
+            memset(disk.map, 0, disk.layout_size);
+        }
+        else {
+            char buf[4096] = {'\0'};
+            for (off_t i = 0; i < disk.layout_size; i += 4096)
+            {                                         /* 末块不超出设备，镜像不会因此变大 */
+                pwrite(fd, buf, disk.layout_size - i < 4096 ? disk.layout_size - i : 4096, i);
+            }
         }
-        lseek(fd, 0, SEEK_SET);
-        disk.read_cnt = 0;
-        disk.write_cnt = 0;
-        disk.seek_cnt = 0;
+        DISK_LOCK(disk);
+        disk.head = 0;
+        reset_stats();
+        DISK_UNLOCK(disk);
         break;
     case IOC_REQ_DEVICE_IO_SZ:
         memcpy(arg, &disk.iounit_size, sizeof(int));
         break;
+    case IOC_REQ_DEVICE_FLUSH:                        /* Flush To Image */
+        if (disk.backend == DDRIVER_BACKEND_MMAP) {
+            return msync(disk.map, disk.layout_size, MS_SYNC) < 0 ? -EIO : 0;
+        }
+        return fsync(fd) < 0 ? -EIO : 0;
+    case IOC_REQ_DEVICE_LAT_MODE:                     /* Switch Latency Model */
+        if (*(int *)arg != DDRIVER_LAT_EMULATE && *(int *)arg != DDRIVER_LAT_RAW) {
+            return -EINVAL;
+        }
+        disk.lat_mode = *(int *)arg;
+        break;
     default:
         break;
     }
@@ -2,6 +2,9 @@
 #define _DDRIVER_CTL_H_
 
 #include <sys/ioctl.h>   
+#include <sys/types.h>
+#include <stdint.h>
+#include <sys/uio.h>
 /******************************************************************************
 * SECTION: IO ctl protocol definitions
 *******************************************************************************/
@@ -13,9 +16,66 @@ struct ddriver_state
     int seek_cnt;
 };
 
+#define DDRIVER_SEEK_HIST_BUCKETS   32
+struct ddriver_seek_hist
+{
+    int bucket[DDRIVER_SEEK_HIST_BUCKETS];              /* bucket[i]: 寻道距离在[2^i, 2^(i+1))个扇区内的次数 */
+};
+
+#define DDRIVER_LAT_HIST_BUCKETS    32
+struct ddriver_stats
+{
+    uint64_t read_cnt;
+    uint64_t write_cnt;
+    uint64_t seek_cnt;
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    uint64_t seek_sectors;                           /* 累计寻道距离(扇区) */
+    uint64_t read_lat_us;                            /* 读请求累计延迟(不含寻道) */
+    uint64_t write_lat_us;                           /* 写请求累计延迟(不含寻道) */
+    uint64_t seek_lat_us;                            /* 寻道(旋转)累计延迟，寻道时间只计在这里 */
+    uint32_t seek_hist[DDRIVER_SEEK_HIST_BUCKETS];   /* bucket[i]: 寻道距离在[2^i, 2^(i+1))个扇区内的次数 */
+    uint32_t read_lat_hist[DDRIVER_LAT_HIST_BUCKETS];  /* bucket[i]: 延迟在[2^i, 2^(i+1))us内的次数, 0计入bucket[0] */
+    uint32_t write_lat_hist[DDRIVER_LAT_HIST_BUCKETS];
+    uint64_t reset_mono_ns;                          /* 上次清零时刻, CLOCK_MONOTONIC */
+    uint64_t reset_real_ns;                          /* 上次清零时刻, CLOCK_REALTIME */
+    uint64_t now_mono_ns;                            /* 取样时刻, CLOCK_MONOTONIC */
+};
+
+#define DDRIVER_BACKEND_FILE    0                   /* pread/pwrite 访问镜像文件 */
+#define DDRIVER_BACKEND_MMAP    1                   /* mmap(MAP_SHARED) 映射镜像, 读写即memcpy */
+#define DDRIVER_LAT_EMULATE     0                   /* 模拟寻道与读写延迟 */
+#define DDRIVER_LAT_RAW         1                   /* 不计延迟, 用于单独测量文件系统开销 */
+#define DDRIVER_SCHED_NOOP      0                   /* 按到达顺序, 只合并相接的请求 */
+#define DDRIVER_SCHED_SCAN      1                   /* 电梯: 按磁头方向扫描排序后合并 */
+#define DDRIVER_SCHED_DEADLINE  2                   /* 电梯序, 但超过截止期的请求优先 */
+
 #define IOC_REQ_DEVICE_SIZE     _IOR(IOC_MAGIC, 0, int)
 #define IOC_REQ_DEVICE_STATE    _IOR(IOC_MAGIC, 1, struct ddriver_state)
 #define IOC_REQ_DEVICE_RESET    _IO(IOC_MAGIC, 2)
 #define IOC_REQ_DEVICE_IO_SZ    _IOR(IOC_MAGIC, 3, int)
+#define IOC_REQ_DEVICE_SEEK_HIST _IOR(IOC_MAGIC, 4, struct ddriver_seek_hist)
+#define IOC_REQ_DEVICE_FLUSH    _IO(IOC_MAGIC, 5)
+#define IOC_REQ_DEVICE_LAT_MODE _IOW(IOC_MAGIC, 6, int)
+#define IOC_REQ_DEVICE_SIZE64   _IOR(IOC_MAGIC, 7, uint64_t)
+#define IOC_REQ_DEVICE_SCHED    _IOW(IOC_MAGIC, 8, int)
+#define IOC_REQ_DEVICE_STATS    _IOR(IOC_MAGIC, 9, struct ddriver_stats)
+#define IOC_REQ_DEVICE_STATS_RESET _IO(IOC_MAGIC, 10)
+
+/******************************************************************************
+* SECTION: Async IO protocol definitions
+*******************************************************************************/
+#define DDRIVER_QUEUE_DEPTH     64                  /* 最多在途的异步请求数 */
+#define DDRIVER_OP_READ         0
+#define DDRIVER_OP_WRITE        1
 
+struct ddriver_req
+{
+    int                 op;                         /* DDRIVER_OP_READ / DDRIVER_OP_WRITE */
+    const struct iovec *iov;                        /* 每段长度须为扇区大小整数倍 */
+    int                 iovcnt;
+    off_t               offset;                     /* 须对齐到扇区 */
+    int                 res;                        /* 完成后: 读写字节数或-errno */
+    void               *priv;                       /* 调用者私有数据 */
+};
 #endif
\ No newline at end of file
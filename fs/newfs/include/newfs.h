@@ -24,23 +24,85 @@
 *******************************************************************************/
 char* 			   nfs_get_fname(const char* path);
 int 			   nfs_calc_lvl(const char * path);
-int 			   nfs_driver_read(int offset, uint8_t *out_content, int size);
-int 			   nfs_driver_write(int offset, uint8_t *in_content, int size);
+int 			   nfs_driver_read(off_t offset, uint8_t *out_content, int size);
+int 			   nfs_driver_write(off_t offset, uint8_t *in_content, int size);
 
 int 			   nfs_mount(struct custom_options options);
 int 			   nfs_umount();
 
+int 			   nfs_reserve_dentry(struct nfs_inode * inode);
 int 			   nfs_alloc_dentry(struct nfs_inode* inode, struct nfs_dentry* dentry);
 int 			   nfs_drop_dentry(struct nfs_inode * inode, struct nfs_dentry * dentry);
+int 			   nfs_alloc_data_blk(int goal);
+void 			   nfs_free_data_blk(int bno);
+int 			   nfs_read_file_blk(struct nfs_inode* inode, int lblk, int bias, uint8_t* out_content, int len);
+int 			   nfs_map_file(struct nfs_inode* inode, off_t offset, int size);
+int 			   nfs_write_file_blk(struct nfs_inode* inode, int lblk, int bias, uint8_t* in_content, int len);
+int 			   nfs_read_file(struct nfs_inode* inode, off_t offset, uint8_t* out_content, int size);
+int 			   nfs_readahead_file(struct nfs_inode* inode, off_t offset, int blks);
+int 			   nfs_write_file(struct nfs_inode* inode, off_t offset, uint8_t* in_content, int size);
+int 			   nfs_read_file_buf(struct nfs_inode* inode, off_t offset, int size, struct fuse_bufvec** bufp);
+int 			   nfs_write_file_buf(struct nfs_inode* inode, off_t offset, struct fuse_bufvec* src);
 struct nfs_inode*  nfs_alloc_inode(struct nfs_dentry * dentry);
 int 			   nfs_sync_inode(struct nfs_inode * inode);
+void 			   nfs_mark_dirty(struct nfs_inode * inode);
+int 			   nfs_sync_dirty();
 int 			   nfs_drop_inode(struct nfs_inode * inode);
 struct nfs_inode*  nfs_read_inode(struct nfs_dentry * dentry, int ino);
+int 			   nfs_read_dentrys(struct nfs_inode * inode);
 struct nfs_dentry* nfs_get_dentry(struct nfs_inode * inode, int dir);
+int 			   nfs_load_dir_inodes(struct nfs_inode * inode, int from);
+void 			   nfs_compact_dentrys(struct nfs_inode * inode);
+struct nfs_dentry* nfs_find_dentry(struct nfs_inode * inode, const char * fname);
 
 struct nfs_dentry* nfs_lookup(const char * path, boolean* is_find, boolean* is_root);
 
 
+/******************************************************************************
+* SECTION: nfs_cache.c
+*******************************************************************************/
+int 			   nfs_cache_init(int capacity);
+struct nfs_buf*    nfs_cache_get(int blk, boolean fill);
+struct nfs_buf*    nfs_cache_find(int blk);
+int 			   nfs_cache_prefetch(const int* blks, int cnt);
+int 			   nfs_cache_readahead(int blk, int cnt);
+void 			   nfs_cache_mark_dirty(struct nfs_buf* buf);
+int 			   nfs_cache_flush();
+void 			   nfs_cache_destroy();
+
+/******************************************************************************
+* SECTION: nfs_bitmap.c
+*******************************************************************************/
+void 			   nfs_bitmap_init(struct nfs_bitmap* bm, uint8_t* map, int bits, int free_cnt);
+int 			   nfs_bitmap_alloc(struct nfs_bitmap* bm, int goal);
+void 			   nfs_bitmap_free(struct nfs_bitmap* bm, int idx);
+
+/******************************************************************************
+* SECTION: nfs_bmap.c
+*******************************************************************************/
+void 			   nfs_bmap_init(struct nfs_inode* inode);
+int 			   nfs_bmap(struct nfs_inode* inode, int lblk, int* run);
+int 			   nfs_bmap_extend(struct nfs_inode* inode);
+void 			   nfs_bmap_release(struct nfs_inode* inode);
+int 			   nfs_bmap_load(struct nfs_inode* inode, struct nfs_inode_d* inode_d);
+int 			   nfs_bmap_store(struct nfs_inode* inode, struct nfs_inode_d* inode_d);
+
+/******************************************************************************
+* SECTION: nfs_dcache.c
+*******************************************************************************/
+int 			   nfs_dcache_init(int capacity);
+struct nfs_dentry* nfs_dcache_lookup(const char* path, boolean* is_find);
+void 			   nfs_dcache_insert(const char* path, struct nfs_dentry* dentry, boolean is_find);
+void 			   nfs_dcache_invalidate(const char* path, boolean subtree);
+void 			   nfs_dcache_destroy();
+
+/******************************************************************************
+* SECTION: nfs_handle.c
+*******************************************************************************/
+struct nfs_handle* nfs_handle_open(struct nfs_inode* inode);
+void 			   nfs_handle_release(struct nfs_handle* handle);
+boolean 		   nfs_handle_seq(struct nfs_handle* handle, off_t offset, int size);
+
 /******************************************************************************
 * SECTION: newfs.c
 *******************************************************************************/
@@ -55,17 +117,25 @@ int   			   newfs_write(const char *, const char *, size_t, off_t,
 					                  struct fuse_file_info *);
 int   			   newfs_read(const char *, char *, size_t, off_t,
 					                 struct fuse_file_info *);
+int   			   newfs_write_buf(const char *, struct fuse_bufvec *, off_t,
+					                      struct fuse_file_info *);
+int   			   newfs_read_buf(const char *, struct fuse_bufvec **, size_t, off_t,
+					                     struct fuse_file_info *);
 int   			   newfs_access(const char *, int);
 int   			   newfs_unlink(const char *);
 int   			   newfs_rmdir(const char *);
 int   			   newfs_rename(const char *, const char *);
 int   			   newfs_utimens(const char *, const struct timespec tv[2]);
+int   			   newfs_statfs(const char *, struct statvfs *);
 int   			   newfs_truncate(const char *, off_t);
 			
 int   			   newfs_open(const char *, struct fuse_file_info *);
 int   			   newfs_opendir(const char *, struct fuse_file_info *);
+int   			   newfs_release(const char *, struct fuse_file_info *);
+int   			   newfs_releasedir(const char *, struct fuse_file_info *);
 /******************************************************************************
 * SECTION: nfs_debug.c
 *******************************************************************************/
 void 			   nfs_dump_map();
+void 			   nfs_dump_stat();
 #endif  /* _newfs_H_ */
\ No newline at end of file
@@ -23,7 +23,7 @@ typedef enum nfs_file_type
 #define UINT32_BITS 32
 #define UINT8_BITS 8
 
-#define NFS_MAGIC_NUM 0x20111427
+#define NFS_MAGIC_NUM 0x2011142D // 布局变化时更换: 文件大小与已用空间改为64位
 #define NFS_SUPER_OFS 0
 #define NFS_ROOT_INO 0
 
@@ -37,23 +37,34 @@ typedef enum nfs_file_type
 #define NFS_ERROR_UNSUPPORTED ENXIO
 #define NFS_ERROR_IO EIO       /* Error Input/Output */
 #define NFS_ERROR_INVAL EINVAL /* Invalid Args */
+#define NFS_ERROR_NOTEMPTY ENOTEMPTY
+#define NFS_ERROR_NOTDIR ENOTDIR
+#define NFS_ERROR_NOMEM ENOMEM
 
 #define NFS_MAX_FILE_NAME 128
 #define SFS_INODE_PER_FILE 1
-#define NFS_DATA_PER_FILE 6   // 文件最大为6*1024KB
+#define NFS_INLINE_EXTENTS 3  // inode内直接存放的extent数，更多的存入溢出extent块
+#define NFS_DIRECT_BLKS 5     // 直接块个数，与一次、二次间接块号一起和inline extent共用inode中的空间
+#define NFS_INVALID_BNO -1    // 无效的数据块号
 #define NFS_DEFAULT_PERM 0777 /* 全权限打开 */
 
 #define NFS_IOC_MAGIC 'S'
 #define NFS_IOC_SEEK _IO(NFS_IOC_MAGIC, 0)
 
+#define NFS_INODE_FLAG_INDIRECT 0x1 // 数据块按直接/间接块映射，否则按extent映射
+
 #define NFS_FLAG_BUF_DIRTY 0x1
 #define NFS_FLAG_BUF_OCCUPY 0x2
 
+#define NFS_CACHE_DEFAULT_BLKS 256 // 默认缓存256个块(256KB)
+#define NFS_SEQ_THRESHOLD 2        // 连续这么多次顺序读后开始预读
+#define NFS_SEQ_READAHEAD_BLKS 32  // 顺序读时在请求之后预读的块数
+#define NFS_CACHE_HASH_SZ 512      // 缓存哈希桶数，须为2的幂
+#define NFS_DCACHE_DEFAULT_ENTRIES 1024 // 默认缓存1024条路径解析结果
+#define NFS_DIR_HASH_INIT 16       // 目录项哈希表初始桶数，须为2的幂，项数超过桶数时翻倍
+
 #define NFS_SUPER_BLOCKS 1
-#define NFS_MAP_INODE_BLOCKS 1
-#define NFS_MAP_DATA_BLOCKS 1
-#define NFS_INODE_BLOCKS 512 
-#define NFS_DATA_BLOCKS 2048 // 3072 
+#define NFS_INODE_RATIO 8 // 每8个块配1个inode，4MB磁盘时为512个，inode表占32块(与fs.layout一致)，其余块均作数据块
 /******************************************************************************
  * SECTION: Macro Function
  *******************************************************************************/
@@ -65,13 +76,25 @@ typedef enum nfs_file_type
 #define NFS_ROUND_DOWN(value, round) ((value) % (round) == 0 ? (value) : ((value) / (round)) * (round))
 #define NFS_ROUND_UP(value, round) ((value) % (round) == 0 ? (value) : ((value) / (round) + 1) * (round))
 
-#define NFS_BLKS_SZ(blks) ((blks)*NFS_BLK_SZ())
+#define NFS_BLKS_SZ(blks) ((uint64_t)(blks)*NFS_BLK_SZ())
 #define NFS_ASSIGN_FNAME(pnfs_dentry, _fname) memcpy(pnfs_dentry->fname, _fname, strlen(_fname))
-#define NFS_INO_OFS(ino) (nfs_super.inode_offset + (ino)*NFS_BLK_SZ())
-#define NFS_DATA_OFS(bno) (nfs_super.data_offset + (bno)*NFS_BLK_SZ())
+#define NFS_INODE_PER_BLK() (NFS_BLK_SZ() / sizeof(struct nfs_inode_d)) // 每块存放的inode数，inode不跨块
+#define NFS_INODE_BLKS(inos) (((inos) + NFS_INODE_PER_BLK() - 1) / NFS_INODE_PER_BLK())
+#define NFS_DENTRY_PER_BLK() (NFS_BLK_SZ() / sizeof(struct nfs_dentry_d)) // 每块存放的目录项数
+#define NFS_PTR_PER_BLK() (NFS_BLK_SZ() / sizeof(int)) // 每个间接块存放的块号数
+#define NFS_EXTENT_PER_BLK() ((NFS_BLK_SZ() - sizeof(struct nfs_extent_blk_d)) / sizeof(struct nfs_extent_d)) // 每个溢出extent块存放的extent数
+#define NFS_INO_OFS(ino) (nfs_super.inode_offset + NFS_BLKS_SZ((ino) / NFS_INODE_PER_BLK()) + \
+                          ((ino) % NFS_INODE_PER_BLK()) * sizeof(struct nfs_inode_d))
+#define NFS_DATA_OFS(bno) (nfs_super.data_offset + NFS_BLKS_SZ(bno))
+#define NFS_INO_BLK(ino) (NFS_INO_OFS(ino) / NFS_BLK_SZ())
+#define NFS_DATA_BLK(bno) (NFS_DATA_OFS(bno) / NFS_BLK_SZ())
+
+#define NFS_CACHE_HASH(blk) ((blk) & (NFS_CACHE_HASH_SZ - 1))
+#define NFS_BUF_IS_DIRTY(pbuf) ((pbuf)->flags & NFS_FLAG_BUF_DIRTY)
 
 #define NFS_IS_DIR(pinode) (pinode->dentry->ftype == NFS_DIR)
 #define NFS_IS_REG(pinode) (pinode->dentry->ftype == NFS_REG_FILE)
+#define NFS_HANDLE(fi) ((struct nfs_handle *)(uintptr_t)(fi)->fh)
 /******************************************************************************
  * SECTION: FS Specific Structure - In memory structure
  *******************************************************************************/
@@ -82,6 +105,67 @@ struct nfs_super;
 struct custom_options
 {
     const char *device; // 驱动路径
+    int cache_blocks;   // 块缓存容量(块数)，0表示不使用缓存
+    int dcache_entries; // 路径缓存容量(条数)，0表示不使用
+    int indirect;       // 新建的inode按直接/间接块映射
+};
+
+struct nfs_buf
+{
+    int blk;               // 缓存的逻辑块号
+    flag16 flags;          // NFS_FLAG_BUF_OCCUPY: 已装入块 NFS_FLAG_BUF_DIRTY: 需写回
+    uint8_t *data;         // 块内容，大小为NFS_BLK_SZ()
+    struct nfs_buf *prev;  // LRU链表，靠近头部的为最近使用
+    struct nfs_buf *next;
+    struct nfs_buf *hnext; // 同一哈希桶中的下一个缓存块
+};
+
+struct nfs_cache
+{
+    int capacity;                // 最多缓存的块数
+    int cnt;                     // 已分配的缓存块数
+    struct nfs_buf *lru_head;    // 最近使用
+    struct nfs_buf *lru_tail;    // 最久未使用，优先被换出
+    struct nfs_buf **hash;       // 块号 -> 缓存块
+
+    int hit_cnt;                 // 命中次数
+    int miss_cnt;                // 未命中次数
+    int writeback_cnt;           // 写回的块数
+    int prefetch_cnt;            // 异步预读入的块数
+};
+
+struct nfs_dcache_entry
+{
+    char *path;                     // 完整路径，作为键
+    uint32_t hash;
+    struct nfs_dentry *dentry;      // 路径存在时为其dentry，否则为父目录的dentry
+    boolean is_find;                // 路径是否存在
+    struct nfs_dcache_entry *hnext; // 同一哈希桶中的下一项，空闲时串成空闲链表
+    struct nfs_dcache_entry *prev;  // LRU链表
+    struct nfs_dcache_entry *next;
+};
+
+struct nfs_dcache
+{
+    int capacity;                       // 最多缓存的路径数
+    int cnt;
+    int hash_sz;                        // 哈希桶数，2的幂
+    struct nfs_dcache_entry **hash;
+    struct nfs_dcache_entry *entries;   // 所有项一次分配
+    struct nfs_dcache_entry *free_list;
+    struct nfs_dcache_entry *lru_head;
+    struct nfs_dcache_entry *lru_tail;
+
+    int hit_cnt;
+    int miss_cnt;
+};
+
+struct nfs_bitmap
+{
+    uint64_t *words; // 位图内容，按64位字访问
+    int bits;        // 有效位数
+    int cursor;      // next-fit游标，下次分配从这里开始找
+    int free_cnt;    // 空闲位数，随分配与释放更新
 };
 
 struct nfs_super
@@ -90,22 +174,36 @@ struct nfs_super
     int fd;
     /* TODO: Define yourself */
     int sz_io;    // 一次io操作的字节数 512B
-    int sz_disk;  // 磁盘大小
-    int sz_usage; // 当前磁盘已经使用的大小
+    uint64_t sz_disk; // 磁盘大小
+    uint64_t sz_usage; // 当前磁盘已经使用的大小
     int sz_blk;   // 1024B
 
     int max_ino;          // 最多支持的文件数
     uint8_t *map_inode;   // inode位图的内存起点
     int map_inode_blks;   // inode位图占用的块数
-    int map_inode_offset; // inode位图在磁盘上的偏移
+    uint64_t map_inode_offset; // inode位图在磁盘上的偏移
 
     int max_data;
     uint8_t *map_data;   // data位图的内存起点
     int map_data_blks;   // data位图占用的块数
-    int map_data_offset; // data位图在磁盘上的偏移
+    uint64_t map_data_offset; // data位图在磁盘上的偏移
+
+    struct nfs_bitmap inode_bm; // map_inode上的按字视图
+    struct nfs_bitmap data_bm;  // map_data上的按字视图
+
+    uint64_t inode_offset; // 索引结点的偏移
+    uint64_t data_offset;  // 数据块的偏移
 
-    int inode_offset; // 索引结点的偏移
-    int data_offset;  // 数据块的偏移
+    struct nfs_cache cache; // 块缓存
+    struct nfs_dcache dcache; // 路径 -> dentry缓存
+    boolean bmap_indirect;    // 新建的inode按直接/间接块映射
+    int saved_read_blks;    // 整块覆盖写时省去的预读块数
+    uint8_t *bounce;        // 不经缓存时首尾非整块部分的中转区，两个块大小，挂载时分配
+    uint8_t *zero_blk;      // 全0块，用于清零新块和读出未映射的块
+
+    struct nfs_inode *dirty_head; // 脏inode链表，只有其中的inode需要写回
+    int sync_inode_cnt;           // 写回的inode数
+    int sync_dblk_cnt;            // 写回的目录块数
 
     boolean is_mounted;
     struct nfs_dentry *root_dentry; // 根目录项
@@ -115,16 +213,46 @@ struct nfs_inode
 {
     uint32_t ino; // 在inode位图中的下标
     /* TODO: Define yourself */
-    uint32_t size;             // 已占用空间
+    uint64_t size;             // 已占用空间
     uint32_t link;             // 连接数
     struct nfs_dentry *dentry; // 指向该inode的父dentry
 
     NFS_FILE_TYPE ftype;        // 文件类型：普通/目录
     uint32_t dir_cnt;           // 目录下目录项个数
     struct nfs_dentry *dentrys; // 指向目录下所有子项文件
+    struct nfs_dentry **dhash;  // 目录项哈希表，按完整文件名索引子项
+    int dhash_sz;               // 哈希桶数，为2的幂，0表示尚未建立
+    struct nfs_dentry **dslots; // 按磁盘上的位置索引子项，dslots[i]存于第i个目录项槽
+    int dslots_cnt;             // 已用的槽数，含目录打开期间删除留下的空槽
+    int dslots_cap;
+    boolean dentrys_loaded;     // 目录项已读入；目录被查找经过或打开时才读入，此前dir_cnt取自磁盘
+
+    boolean dirty;                 // 在脏链表中，sync时写回
+    int open_cnt;                  // 打开的句柄数，不为0时unlink推迟到最后一次release释放
+    boolean unlinked;              // 已从目录中删除，等待最后一个句柄关闭
+    struct nfs_inode *dirty_prev;  // 脏inode链表
+    struct nfs_inode *dirty_next;
 
-    uint32_t block_pointer[NFS_DATA_PER_FILE]; // 数据块指针
-    int bno[NFS_DATA_PER_FILE];                // 数据块在磁盘中的块号
+    uint32_t flags;               // NFS_INODE_FLAG_*
+    uint32_t blk_cnt;             // 已映射的数据块数
+    struct nfs_extent_d *extents; // 全部extent，按逻辑块顺序排列
+    int ext_cnt;
+    int ext_cap;                  // extents数组的容量
+    int *ext_blks;                // 溢出extent块的块号，按链表顺序排列
+    int ext_blk_cnt;
+    int direct[NFS_DIRECT_BLKS];  // 直接块号
+    int ind;                      // 一次间接块号
+    int dind;                     // 二次间接块号
+    int *ind_map;                 // 一次间接块的内容，首次用到时读入并常驻
+    int *dind_map;                // 二次间接块的内容
+    int **dind_leaf;              // 二次间接块下各一次间接块的内容，按需读入
+};
+
+struct nfs_handle
+{
+    struct nfs_inode *inode; // open/opendir时解析出的inode，之后的读写不再查路径
+    off_t next_ofs;          // 上次读结束处，下一次从这里读即为顺序读
+    int seq_cnt;             // 连续顺序读的次数
 };
 
 struct nfs_dentry
@@ -139,11 +267,19 @@ struct nfs_dentry
     struct nfs_dentry *parent;  // 父inode的dentry
     struct nfs_dentry *brother; // 下一个兄弟inode的dentry
     struct nfs_dentry *child;   // 目录下子inode的dentry
+    uint32_t hash;              // 文件名哈希
+    struct nfs_dentry *hnext;   // 父目录哈希表同一桶中的下一个目录项
+    int slot;                   // 在父目录中的槽号，决定其所在的目录块
+    boolean dirty;              // 所在目录块需要写回
 };
 
 static inline struct nfs_dentry *new_dentry(char *fname, NFS_FILE_TYPE ftype)
 {
     struct nfs_dentry *dentry = (struct nfs_dentry *)malloc(sizeof(struct nfs_dentry));
+    if (dentry == NULL)
+    {
+        return NULL;
+    }
     memset(dentry, 0, sizeof(struct nfs_dentry));
     NFS_ASSIGN_FNAME(dentry, fname);
     dentry->ftype = ftype;
@@ -153,6 +289,7 @@ static inline struct nfs_dentry *new_dentry(char *fname, NFS_FILE_TYPE ftype)
     dentry->parent = NULL;
     dentry->brother = NULL;
     dentry->child = NULL;
+    dentry->hnext = NULL;
     return dentry;
 }
 
@@ -162,25 +299,55 @@ static inline struct nfs_dentry *new_dentry(char *fname, NFS_FILE_TYPE ftype)
 struct nfs_super_d
 {
     uint32_t magic;
-    int sz_usage; // 当前磁盘已经使用的大小
+    uint64_t sz_usage; // 当前磁盘已经使用的大小
 
-    int map_inode_blks;   // inode位图占用的块数
-    int map_inode_offset; // inode位图在磁盘上的偏移
+    int max_ino;  // inode个数
+    int max_data; // 数据块个数
+    int free_ino;  // 空闲inode数
+    int free_data; // 空闲数据块数
 
-    int map_data_blks;   // data位图占用的块数
-    int map_data_offset; // data位图在磁盘上的偏移
+    int map_inode_blks;        // inode位图占用的块数
+    uint64_t map_inode_offset; // inode位图在磁盘上的偏移
 
-    int inode_offset; // 索引结点的偏移
-    int data_offset;  // 数据块的偏移
+    int map_data_blks;        // data位图占用的块数
+    uint64_t map_data_offset; // data位图在磁盘上的偏移
+
+    uint64_t inode_offset; // 索引结点的偏移
+    uint64_t data_offset;  // 数据块的偏移
+};
+
+struct nfs_extent_d
+{
+    int start; // 起始数据块号
+    int len;   // 连续的块数
+};
+
+struct nfs_extent_blk_d
+{
+    int next; // 下一个溢出extent块，无则为NFS_INVALID_BNO
+    int cnt;  // 本块中的extent数，其后紧跟cnt个nfs_extent_d
 };
 
 struct nfs_inode_d
 {
-    uint32_t ino;               // 在inode位图中的下标
-    uint32_t size;              // 已占用空间
-    NFS_FILE_TYPE ftype;        // 文件类型：普通/目录
-    uint32_t dir_cnt;           // 目录下目录项个数
-    int bno[NFS_DATA_PER_FILE]; // 数据块在磁盘中的块号
+    uint64_t size;                              // 已占用空间，放在最前使inode_d保持64字节
+    uint32_t ino;                               // 在inode位图中的下标
+    NFS_FILE_TYPE ftype;                        // 文件类型：普通/目录
+    uint32_t dir_cnt;                           // 目录下目录项个数
+    uint32_t flags;                             // NFS_INODE_FLAG_*
+    uint32_t blk_cnt;                           // 已映射的数据块数
+    uint32_t ext_cnt;                           // extent总数
+    int ext_blk;                                // 第一个溢出extent块，无则为NFS_INVALID_BNO
+    union
+    {
+        struct nfs_extent_d ext[NFS_INLINE_EXTENTS]; // 前NFS_INLINE_EXTENTS个extent
+        struct
+        {
+            int direct[NFS_DIRECT_BLKS]; // 直接块号
+            int ind;                     // 一次间接块号
+            int dind;                    // 二次间接块号
+        } blk;
+    } map;
 };
 
 struct nfs_dentry_d
@@ -10,6 +10,9 @@
 *******************************************************************************/
 static const struct fuse_opt option_spec[] = {		/* 用于FUSE文件系统解析参数 */
 	OPTION("--device=%s", device),
+	OPTION("--cache-blocks=%d", cache_blocks),
+	OPTION("--dcache-entries=%d", dcache_entries),
+	OPTION("--indirect", indirect),
 	FUSE_OPT_END
 };
 
@@ -25,16 +28,21 @@ static struct fuse_operations operations = {
 	.getattr = newfs_getattr,				 /* 获取文件属性，类似stat，必须完成 */
 	.readdir = newfs_readdir,				 /* 填充dentrys */
 	.mknod = newfs_mknod,					 /* 创建文件，touch相关 */
-	.write = NULL,								  	 /* 写入文件 */
-	.read = NULL,								  	 /* 读文件 */
+	.write = newfs_write,					 /* 写入文件 */
+	.read = newfs_read,						 /* 读文件 */
+	.write_buf = newfs_write_buf,			 /* 写入文件，数据可直接从管道splice */
+	.read_buf = newfs_read_buf,				 /* 读文件，数据可直接splice到管道 */
 	.utimens = newfs_utimens,				 /* 修改时间，忽略，避免touch报错 */
 	.truncate = NULL,						  		 /* 改变文件大小 */
-	.unlink = NULL,							  		 /* 删除文件 */
-	.rmdir	= NULL,							  		 /* 删除目录， rm -r */
-	.rename = NULL,							  		 /* 重命名，mv */
+	.unlink = newfs_unlink,					 /* 删除文件 */
+	.rmdir	= newfs_rmdir,					 /* 删除目录， rm -r */
+	.rename = newfs_rename,					 /* 重命名，mv */
+	.statfs = newfs_statfs,					 /* 文件系统容量，df */
 
-	.open = NULL,							
-	.opendir = NULL,
+	.open = newfs_open,						 /* 打开文件，建立句柄 */
+	.opendir = newfs_opendir,				 /* 打开目录，建立句柄 */
+	.release = newfs_release,				 /* 关闭文件，释放句柄 */
+	.releasedir = newfs_releasedir,			 /* 关闭目录，释放句柄 */
 	.access = NULL
 };
 /******************************************************************************
@@ -43,11 +51,17 @@ static struct fuse_operations operations = {
 /**
  * @brief 挂载（mount）文件系统
  * 
- * @param conn_info 可忽略，一些建立连接相关的信息 
+ * @param conn_info 一些建立连接相关的信息，用于协商readdirplus
  * @return void*
  */
 void* newfs_init(struct fuse_conn_info * conn_info) {
 	/* TODO: 在这里进行挂载 */
+#ifdef FUSE_CAP_READDIRPLUS
+	/* libfuse支持时启用readdirplus，readdir填充的属性直接进入内核缓存 */
+	if (conn_info->capable & FUSE_CAP_READDIRPLUS) {
+		conn_info->want |= FUSE_CAP_READDIRPLUS;
+	}
+#endif
 	if (nfs_mount(nfs_options) != NFS_ERROR_NONE) {
         NFS_DBG("[%s] mount error\n", __func__);
 		fuse_exit(fuse_get_context()->fuse);
@@ -91,6 +105,9 @@ int newfs_mkdir(const char* path, mode_t mode) {
 	struct nfs_dentry* dentry;
 	struct nfs_inode*  inode;
 
+	if (last_dentry == NULL) {
+		return -NFS_ERROR_IO;
+	}
 	if (is_find) {
 		return -NFS_ERROR_EXISTS;
 	}
@@ -101,47 +118,74 @@ int newfs_mkdir(const char* path, mode_t mode) {
 
 	fname  = nfs_get_fname(path);
 	dentry = new_dentry(fname, NFS_DIR); 
+	if (dentry == NULL) {
+		return -NFS_ERROR_NOMEM;
+	}
 	dentry->parent = last_dentry;
 	inode  = nfs_alloc_inode(dentry);
-	nfs_alloc_dentry(last_dentry->inode, dentry);
+	if (inode == NULL) {
+		free(dentry);
+		return -NFS_ERROR_NOSPACE;
+	}
+	if (nfs_alloc_dentry(last_dentry->inode, dentry) < 0) {	/* 父目录已满 */
+		nfs_drop_inode(inode);
+		free(dentry);
+		return -NFS_ERROR_NOSPACE;
+	}
+	nfs_dcache_invalidate(path, FALSE);				/* 去掉"不存在"的缓存结果 */
 	
 	return NFS_ERROR_NONE;
 }
 
 /**
- * @brief 获取文件或目录的属性，该函数非常重要
+ * @brief 由已载入的inode填充属性，getattr与readdir共用
  * 
- * @param path 相对于挂载点的路径
+ * @param inode 
  * @param newfs_stat 返回状态
- * @return int 0成功，否则失败
  */
-int newfs_getattr(const char* path, struct stat * newfs_stat) {
-	/* TODO: 解析路径，获取Inode，填充newfs_stat，可参考/fs/simplefs/sfs.c的sfs_getattr()函数实现 */
-	boolean	is_find, is_root;
-	struct nfs_dentry* dentry = nfs_lookup(path, &is_find, &is_root);
-	if (is_find == FALSE) {
-		return -NFS_ERROR_NOTFOUND;
-	}
-
-	if (NFS_IS_DIR(dentry->inode)) {
+static void newfs_fill_stat(struct nfs_inode* inode, struct stat * newfs_stat) {
+	memset(newfs_stat, 0, sizeof(struct stat));
+	if (NFS_IS_DIR(inode)) {
 		newfs_stat->st_mode = S_IFDIR | NFS_DEFAULT_PERM;
-		newfs_stat->st_size = dentry->inode->dir_cnt * sizeof(struct nfs_dentry_d);
+		newfs_stat->st_size = inode->dir_cnt * sizeof(struct nfs_dentry_d);
 	}
-	else if (NFS_IS_REG(dentry->inode)) {
+	else if (NFS_IS_REG(inode)) {
 		newfs_stat->st_mode = S_IFREG | NFS_DEFAULT_PERM;
-		newfs_stat->st_size = dentry->inode->size;
+		newfs_stat->st_size = inode->size;
 	}
-	// else if (NFS_IS_SYM_LINK(dentry->inode)) {
+	// else if (NFS_IS_SYM_LINK(inode)) {
 	// 	newfs_stat->st_mode = S_IFLNK | NFS_DEFAULT_PERM;
-	// 	newfs_stat->st_size = dentry->inode->size;
+	// 	newfs_stat->st_size = inode->size;
 	// }
 
+	newfs_stat->st_ino	 = inode->ino;
 	newfs_stat->st_nlink = 1;
 	newfs_stat->st_uid 	 = getuid();
 	newfs_stat->st_gid 	 = getgid();
 	newfs_stat->st_atime   = time(NULL);
 	newfs_stat->st_mtime   = time(NULL);
 	newfs_stat->st_blksize = NFS_BLK_SZ(); 
+}
+
+/**
+ * @brief 获取文件或目录的属性，该函数非常重要
+ * 
+ * @param path 相对于挂载点的路径
+ * @param newfs_stat 返回状态
+ * @return int 0成功，否则失败
+ */
+int newfs_getattr(const char* path, struct stat * newfs_stat) {
+	/* TODO: 解析路径，获取Inode，填充newfs_stat，可参考/fs/simplefs/sfs.c的sfs_getattr()函数实现 */
+	boolean	is_find, is_root;
+	struct nfs_dentry* dentry = nfs_lookup(path, &is_find, &is_root);
+	if (dentry == NULL) {
+		return -NFS_ERROR_IO;
+	}
+	if (is_find == FALSE) {
+		return -NFS_ERROR_NOTFOUND;
+	}
+
+	newfs_fill_stat(dentry->inode, newfs_stat);
 
 	if (is_root) {
 		newfs_stat->st_size	= nfs_super.sz_usage; 
@@ -151,6 +195,24 @@ int newfs_getattr(const char* path, struct stat * newfs_stat) {
 	return NFS_ERROR_NONE;
 }
 
+/**
+ * @brief 取打开句柄中的inode，没有句柄(如未经open的调用)时才解析路径
+ * 
+ * @param path 相对于挂载点的路径
+ * @param fi 文件信息，可为NULL
+ * @return struct nfs_inode* 路径不存在时返回NULL
+ */
+static struct nfs_inode* newfs_fi_inode(const char* path, struct fuse_file_info* fi) {
+	boolean	is_find, is_root;
+	struct nfs_dentry* dentry;
+
+	if (fi && fi->fh) {
+		return NFS_HANDLE(fi)->inode;
+	}
+	dentry = nfs_lookup(path, &is_find, &is_root);
+	return is_find ? dentry->inode : NULL;
+}
+
 /**
  * @brief 遍历目录项，填充至buf，并交给FUSE输出
  * 
@@ -162,27 +224,36 @@ int newfs_getattr(const char* path, struct stat * newfs_stat) {
  *				const struct stat *stbuf, off_t off)
  * buf: name会被复制到buf中
  * name: dentry名字
- * stbuf: 文件状态，可忽略
+ * stbuf: 文件状态，这里由已载入的inode填充
  * off: 下一次offset从哪里开始，这里可以理解为第几个dentry
  * 
- * @param offset 第几个目录项？
+ * @param offset 从第几个目录项(槽号)继续
  * @param fi 可忽略
  * @return int 0成功，否则失败
  */
 int newfs_readdir(const char * path, void * buf, fuse_fill_dir_t filler, off_t offset,
 			    		 struct fuse_file_info * fi) {
-    /* TODO: 解析路径，获取目录的Inode，并读取目录项，利用filler填充到buf，可参考/fs/simplefs/sfs.c的sfs_readdir()函数实现 */
-    boolean	is_find, is_root;
 	int		cur_dir = offset;
 
-	struct nfs_dentry* dentry = nfs_lookup(path, &is_find, &is_root);
+	struct nfs_inode* inode = newfs_fi_inode(path, fi);
 	struct nfs_dentry* sub_dentry;
-	struct nfs_inode* inode;
-	if (is_find) {
-		inode = dentry->inode;
-		sub_dentry = nfs_get_dentry(inode, cur_dir);
-		if (sub_dentry) {
-			filler(buf, sub_dentry->fname, NULL, ++offset);
+	struct stat sub_stat;
+	if (inode) {
+		/* 余下未载入的子inode一次扫描inode表载入，随后带属性填充，ls -l无需逐项getattr读盘 */
+		if (nfs_load_dir_inodes(inode, cur_dir) < 0) {
+			return -NFS_ERROR_IO;
+		}
+		/* offset即下一个槽号，直接从这里继续，一次填到buf满为止。
+		   打开期间删除的子项只留空槽，其余子项槽号不变，续读不会漏项 */
+		for (; cur_dir < inode->dslots_cnt; cur_dir++) {
+			sub_dentry = nfs_get_dentry(inode, cur_dir);
+			if (sub_dentry == NULL) {
+				continue;
+			}
+			newfs_fill_stat(sub_dentry->inode, &sub_stat);
+			if (filler(buf, sub_dentry->fname, &sub_stat, cur_dir + 1)) {
+				break;
+			}
 		}
 		return NFS_ERROR_NONE;
 	}
@@ -206,6 +277,9 @@ int newfs_mknod(const char* path, mode_t mode, dev_t dev) {
 	struct nfs_inode* inode;
 	char* fname;
 	
+	if (last_dentry == NULL) {
+		return -NFS_ERROR_IO;
+	}
 	if (is_find == TRUE) {
 		return -NFS_ERROR_EXISTS;
 	}
@@ -218,9 +292,24 @@ int newfs_mknod(const char* path, mode_t mode, dev_t dev) {
 	else if (S_ISDIR(mode)) {
 		dentry = new_dentry(fname, NFS_DIR);
 	}
+	else {
+		return -NFS_ERROR_UNSUPPORTED;
+	}
+	if (dentry == NULL) {
+		return -NFS_ERROR_NOMEM;
+	}
 	dentry->parent = last_dentry;
 	inode = nfs_alloc_inode(dentry);
-	nfs_alloc_dentry(last_dentry->inode, dentry);
+	if (inode == NULL) {
+		free(dentry);
+		return -NFS_ERROR_NOSPACE;
+	}
+	if (nfs_alloc_dentry(last_dentry->inode, dentry) < 0) {	/* 父目录已满 */
+		nfs_drop_inode(inode);
+		free(dentry);
+		return -NFS_ERROR_NOSPACE;
+	}
+	nfs_dcache_invalidate(path, FALSE);				/* 去掉"不存在"的缓存结果 */
 
 	return NFS_ERROR_NONE;
 }
@@ -236,6 +325,28 @@ int newfs_utimens(const char* path, const struct timespec tv[2]) {
 	(void)path;
 	return NFS_ERROR_NONE;
 }
+
+/**
+ * @brief 获取文件系统容量，直接取内存中的空闲计数，不扫描位图
+ * 
+ * @param path 可忽略
+ * @param newfs_statvfs 
+ * @return int 0成功
+ */
+int newfs_statfs(const char* path, struct statvfs* newfs_statvfs) {
+	(void)path;
+	memset(newfs_statvfs, 0, sizeof(struct statvfs));
+	newfs_statvfs->f_bsize   = NFS_BLK_SZ();
+	newfs_statvfs->f_frsize  = NFS_BLK_SZ();
+	newfs_statvfs->f_blocks  = nfs_super.max_data;
+	newfs_statvfs->f_bfree   = nfs_super.data_bm.free_cnt;
+	newfs_statvfs->f_bavail  = nfs_super.data_bm.free_cnt;
+	newfs_statvfs->f_files   = nfs_super.max_ino;
+	newfs_statvfs->f_ffree   = nfs_super.inode_bm.free_cnt;
+	newfs_statvfs->f_favail  = nfs_super.inode_bm.free_cnt;
+	newfs_statvfs->f_namemax = NFS_MAX_FILE_NAME - 1;
+	return NFS_ERROR_NONE;
+}
 /******************************************************************************
 * SECTION: 选做函数实现
 *******************************************************************************/
@@ -251,8 +362,18 @@ int newfs_utimens(const char* path, const struct timespec tv[2]) {
  */
 int newfs_write(const char* path, const char* buf, size_t size, off_t offset,
 		        struct fuse_file_info* fi) {
-	/* 选做 */
-	return size;
+	struct nfs_inode*  inode = newfs_fi_inode(path, fi);
+
+	if (inode == NULL) {
+		return -NFS_ERROR_NOTFOUND;
+	}
+	
+	if (NFS_IS_DIR(inode)) {
+		return -NFS_ERROR_ISDIR;	
+	}
+
+	/* 逐块拷入块缓存，不经中间缓冲区 */
+	return nfs_write_file(inode, offset, (uint8_t *)buf, size);
 }
 
 /**
@@ -267,8 +388,95 @@ int newfs_write(const char* path, const char* buf, size_t size, off_t offset,
  */
 int newfs_read(const char* path, char* buf, size_t size, off_t offset,
 		       struct fuse_file_info* fi) {
-	/* 选做 */
-	return size;			   
+	struct nfs_inode*  inode = newfs_fi_inode(path, fi);
+
+	if (inode == NULL) {
+		return -NFS_ERROR_NOTFOUND;
+	}
+	
+	if (NFS_IS_DIR(inode)) {
+		return -NFS_ERROR_ISDIR;	
+	}
+
+	if (fi && fi->fh && nfs_handle_seq(NFS_HANDLE(fi), offset, size)) {
+		nfs_readahead_file(inode, offset + size, NFS_SEQ_READAHEAD_BLKS);	/* 顺序读时预读后续块 */
+	}
+	/* 从块缓存直接拷出，读到文件末尾为止 */
+	return nfs_read_file(inode, offset, (uint8_t *)buf, size);
+}
+
+/**
+ * @brief 写入文件，FUSE传入的数据(可能仍在管道中)直接写入缓存块或镜像文件，
+ * 不经用户态的中间缓冲区
+ * 
+ * @param path 相对于挂载点的路径
+ * @param buf 写入的内容
+ * @param offset 相对文件的偏移
+ * @param fi 可忽略
+ * @return int 写入大小
+ */
+int newfs_write_buf(const char* path, struct fuse_bufvec* buf, off_t offset,
+		            struct fuse_file_info* fi) {
+	struct nfs_inode*  inode = newfs_fi_inode(path, fi);
+
+	if (inode == NULL) {
+		return -NFS_ERROR_NOTFOUND;
+	}
+	
+	if (NFS_IS_DIR(inode)) {
+		return -NFS_ERROR_ISDIR;	
+	}
+
+	return nfs_write_file_buf(inode, offset, buf);
+}
+
+/**
+ * @brief 读取文件，只返回描述数据位置的bufvec：已缓存的块指向缓存，
+ * 其余指向镜像文件，由FUSE直接splice到管道
+ * 
+ * @param path 相对于挂载点的路径
+ * @param bufp 返回的bufvec
+ * @param size 读取的字节数
+ * @param offset 相对文件的偏移
+ * @param fi 可忽略
+ * @return int 0成功，否则失败
+ */
+int newfs_read_buf(const char* path, struct fuse_bufvec** bufp, size_t size, off_t offset,
+		           struct fuse_file_info* fi) {
+	struct nfs_inode*  inode = newfs_fi_inode(path, fi);
+
+	if (inode == NULL) {
+		return -NFS_ERROR_NOTFOUND;
+	}
+	
+	if (NFS_IS_DIR(inode)) {
+		return -NFS_ERROR_ISDIR;	
+	}
+
+	/* 顺序读时预读其后的块 */
+	if (fi && fi->fh && nfs_handle_seq(NFS_HANDLE(fi), offset, size)) {
+		nfs_readahead_file(inode, offset + size, NFS_SEQ_READAHEAD_BLKS);
+	}
+	return nfs_read_file_buf(inode, offset, size, bufp);
+}
+
+/**
+ * @brief 从父目录摘下目录项并释放其inode；inode仍被打开时推迟到最后一次release。
+ * unlink、rmdir与覆盖已有目标的rename共用
+ * 
+ * @param path 目录项的路径，用于清除路径缓存
+ * @param dentry 
+ */
+static void newfs_remove(const char* path, struct nfs_dentry* dentry) {
+	/* 目录下"不存在"的缓存结果也指向该dentry */
+	nfs_dcache_invalidate(path, NFS_IS_DIR(dentry->inode));
+	nfs_drop_dentry(dentry->parent->inode, dentry);
+	if (dentry->inode->open_cnt > 0) {
+		dentry->inode->unlinked = TRUE;
+		return;
+	}
+	nfs_drop_inode(dentry->inode);
+	free(dentry);
 }
 
 /**
@@ -278,8 +486,21 @@ int newfs_read(const char* path, char* buf, size_t size, off_t offset,
  * @return int 0成功，否则失败
  */
 int newfs_unlink(const char* path) {
-	/* 选做 */
-	return 0;
+	boolean	is_find, is_root;
+	struct nfs_dentry* dentry = nfs_lookup(path, &is_find, &is_root);
+
+	if (dentry == NULL) {
+		return -NFS_ERROR_IO;
+	}
+	if (is_find == FALSE) {
+		return -NFS_ERROR_NOTFOUND;
+	}
+	if (NFS_IS_DIR(dentry->inode)) {
+		return -NFS_ERROR_ISDIR;
+	}
+
+	newfs_remove(path, dentry);
+	return NFS_ERROR_NONE;
 }
 
 /**
@@ -295,45 +516,213 @@ int newfs_unlink(const char* path) {
  * @return int 0成功，否则失败
  */
 int newfs_rmdir(const char* path) {
-	/* 选做 */
-	return 0;
+	boolean	is_find, is_root;
+	struct nfs_dentry* dentry = nfs_lookup(path, &is_find, &is_root);
+
+	if (dentry == NULL) {
+		return -NFS_ERROR_IO;
+	}
+	if (is_find == FALSE) {
+		return -NFS_ERROR_NOTFOUND;
+	}
+	if (is_root) {
+		return -NFS_ERROR_INVAL;
+	}
+	if (!NFS_IS_DIR(dentry->inode)) {
+		return -NFS_ERROR_NOTDIR;
+	}
+	if (dentry->inode->dir_cnt > 0) {
+		return -NFS_ERROR_NOTEMPTY;
+	}
+
+	newfs_remove(path, dentry);
+	return NFS_ERROR_NONE;
 }
 
 /**
- * @brief 重命名文件 
+ * @brief 重命名文件。目标已存在时将其替换：目标为文件时源不能是目录，
+ * 目标为目录时源须是目录且目标为空
  * 
  * @param from 源文件路径
  * @param to 目标文件路径
  * @return int 0成功，否则失败
  */
 int newfs_rename(const char* from, const char* to) {
-	/* 选做 */
-	return 0;
+	boolean	is_find, is_root;
+	struct nfs_dentry* from_dentry = nfs_lookup(from, &is_find, &is_root);
+	struct nfs_dentry* to_dentry;
+	struct nfs_dentry* to_parent;
+	struct nfs_dentry* from_parent;
+	struct nfs_dentry* dentry_cursor;
+	char* to_dir;
+	int ret;
+
+	if (from_dentry == NULL) {
+		return -NFS_ERROR_IO;
+	}
+	if (is_find == FALSE) {
+		return -NFS_ERROR_NOTFOUND;
+	}
+	if (is_root) {
+		return -NFS_ERROR_INVAL;
+	}
+	if (strcmp(from, to) == 0) {
+		return NFS_ERROR_NONE;
+	}
+
+	to_dentry = nfs_lookup(to, &is_find, &is_root);
+	if (to_dentry == NULL) {
+		return -NFS_ERROR_IO;
+	}
+	if (is_root) {
+		return -NFS_ERROR_INVAL;
+	}
+	if (!is_find) {									/* 目的不存在，直接移入 */
+		to_dentry = NULL;
+	}
+	to_dir = strdup(to);							/* 目的路径的父目录须存在 */
+	*strrchr(to_dir, '/') = '\0';
+	to_parent = nfs_lookup(to_dir[0] ? to_dir : "/", &is_find, &is_root);
+	free(to_dir);
+	if (to_parent == NULL) {
+		return -NFS_ERROR_IO;
+	}
+	if (is_find == FALSE) {
+		return -NFS_ERROR_NOTFOUND;
+	}
+	if (!NFS_IS_DIR(to_parent->inode)) {
+		return -NFS_ERROR_NOTDIR;
+	}
+	for (dentry_cursor = to_parent; dentry_cursor; dentry_cursor = dentry_cursor->parent) {
+		if (dentry_cursor == from_dentry) {			/* 不能移入自己的子树 */
+			return -NFS_ERROR_INVAL;
+		}
+	}
+	if (to_dentry != NULL) {
+		if (NFS_IS_DIR(from_dentry->inode) && !NFS_IS_DIR(to_dentry->inode)) {
+			return -NFS_ERROR_NOTDIR;
+		}
+		if (!NFS_IS_DIR(from_dentry->inode) && NFS_IS_DIR(to_dentry->inode)) {
+			return -NFS_ERROR_ISDIR;
+		}
+		if (NFS_IS_DIR(to_dentry->inode) && to_dentry->inode->dir_cnt > 0) {
+			return -NFS_ERROR_NOTEMPTY;
+		}
+	}
+
+	ret = nfs_reserve_dentry(to_parent->inode);	/* 先在目的目录预留槽，再从源目录摘下 */
+	if (ret != NFS_ERROR_NONE) {
+		return ret;
+	}
+
+	if (to_dentry != NULL) {						/* 预留成功后才删除被替换的目标 */
+		newfs_remove(to, to_dentry);
+	}
+	nfs_dcache_invalidate(from, TRUE);
+	nfs_dcache_invalidate(to, FALSE);
+	from_parent = from_dentry->parent;
+	nfs_drop_dentry(from_parent->inode, from_dentry);
+	memset(from_dentry->fname, 0, sizeof(from_dentry->fname));
+	NFS_ASSIGN_FNAME(from_dentry, nfs_get_fname(to));
+	from_dentry->parent = to_parent;
+	from_dentry->brother = NULL;
+	ret = nfs_alloc_dentry(to_parent->inode, from_dentry);
+	if (ret < 0) {									/* 挂回源目录，不留下无名的inode */
+		memset(from_dentry->fname, 0, sizeof(from_dentry->fname));
+		NFS_ASSIGN_FNAME(from_dentry, nfs_get_fname(from));
+		from_dentry->parent = from_parent;
+		from_dentry->brother = NULL;
+		nfs_alloc_dentry(from_parent->inode, from_dentry);
+		return ret;
+	}
+	return NFS_ERROR_NONE;
 }
 
 /**
- * @brief 打开文件，可以在这里维护fi的信息，例如，fi->fh可以理解为一个64位指针，可以把自己想保存的数据结构
- * 保存在fh中
+ * @brief 打开文件，解析出的inode保存在句柄中，句柄存入fi->fh，
+ * 之后的read/write直接使用，不再解析路径
  * 
  * @param path 相对于挂载点的路径
  * @param fi 文件信息
  * @return int 0成功，否则失败
  */
 int newfs_open(const char* path, struct fuse_file_info* fi) {
-	/* 选做 */
-	return 0;
+	boolean	is_find, is_root;
+	struct nfs_dentry* dentry = nfs_lookup(path, &is_find, &is_root);
+	struct nfs_handle* handle;
+
+	if (dentry == NULL) {
+		return -NFS_ERROR_IO;
+	}
+	if (is_find == FALSE) {
+		return -NFS_ERROR_NOTFOUND;
+	}
+
+	handle = nfs_handle_open(dentry->inode);
+	if (handle == NULL) {
+		return -NFS_ERROR_NOMEM;
+	}
+	fi->fh = (uint64_t)(uintptr_t)handle;
+	return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 关闭文件，释放open时建立的句柄
+ * 
+ * @param path 相对于挂载点的路径
+ * @param fi 文件信息
+ * @return int 0成功，否则失败
+ */
+int newfs_release(const char* path, struct fuse_file_info* fi) {
+	if (fi->fh) {
+		nfs_handle_release(NFS_HANDLE(fi));
+		fi->fh = 0;
+	}
+	return NFS_ERROR_NONE;
 }
 
 /**
- * @brief 打开目录文件
+ * @brief 打开目录文件，与newfs_open一样建立句柄，readdir从中取inode与游标
  * 
  * @param path 相对于挂载点的路径
  * @param fi 文件信息
  * @return int 0成功，否则失败
  */
 int newfs_opendir(const char* path, struct fuse_file_info* fi) {
-	/* 选做 */
-	return 0;
+	boolean	is_find, is_root;
+	struct nfs_dentry* dentry = nfs_lookup(path, &is_find, &is_root);
+	struct nfs_handle* handle;
+
+	if (dentry == NULL) {
+		return -NFS_ERROR_IO;
+	}
+	if (is_find == FALSE) {
+		return -NFS_ERROR_NOTFOUND;
+	}
+	if (!NFS_IS_DIR(dentry->inode)) {
+		return -NFS_ERROR_NOTDIR;
+	}
+	if (nfs_read_dentrys(dentry->inode) != NFS_ERROR_NONE) {	/* 打开时才读入目录项 */
+		return -NFS_ERROR_IO;
+	}
+
+	handle = nfs_handle_open(dentry->inode);
+	if (handle == NULL) {
+		return -NFS_ERROR_NOMEM;
+	}
+	fi->fh = (uint64_t)(uintptr_t)handle;
+	return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 关闭目录，释放opendir时建立的句柄
+ * 
+ * @param path 相对于挂载点的路径
+ * @param fi 文件信息
+ * @return int 0成功，否则失败
+ */
+int newfs_releasedir(const char* path, struct fuse_file_info* fi) {
+	return newfs_release(path, fi);
 }
 
 /**
@@ -374,9 +763,14 @@ int main(int argc, char **argv)
 	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
 
 	nfs_options.device = strdup("/home/AvaCharon/ddriver");
+	nfs_options.cache_blocks = NFS_CACHE_DEFAULT_BLKS;
+	nfs_options.dcache_entries = NFS_DCACHE_DEFAULT_ENTRIES;
 
 	if (fuse_opt_parse(&args, &nfs_options, option_spec, NULL) == -1)
 		return -1;
+	/* 块缓存、目录项与inode均未加锁，只能单线程处理请求 */
+	if (fuse_opt_add_arg(&args, "-s") == -1)
+		return -1;
 	
 	ret = fuse_main(args.argc, args.argv, &operations, NULL);
 	fuse_opt_free_args(&args);
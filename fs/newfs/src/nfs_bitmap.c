@@ -0,0 +1,78 @@
+#include "../include/newfs.h"
+
+#define NFS_WORD_BITS 64
+
+/**
+ * @brief 在已读入内存的位图上建立按64位字访问的视图，不改变磁盘格式：
+ * 第i位为第i/8字节的第i%8位，在小端机器上即第i/64个字的第i%64位
+ *
+ * @param bm
+ * @param map 位图内容，大小为块的整数倍，因而是8字节的整数倍
+ * @param bits 有效位数，其后的位视为已占用
+ * @param free_cnt 空闲位数，由超级块记录，无需扫描位图
+ */
+void nfs_bitmap_init(struct nfs_bitmap *bm, uint8_t *map, int bits, int free_cnt)
+{
+    bm->words = (uint64_t *)map;
+    bm->bits = bits;
+    bm->cursor = 0;
+    bm->free_cnt = free_cnt;
+}
+
+/**
+ * @brief 分配一位：从goal(无效时为next-fit游标)所在的字起逐字找空闲位，到末尾后回绕
+ *
+ * @param bm
+ * @param goal 期望的位，小于0表示从游标处开始
+ * @return int 分配到的位，无空闲位时返回-1
+ */
+int nfs_bitmap_alloc(struct nfs_bitmap *bm, int goal)
+{
+    int nwords = (bm->bits + NFS_WORD_BITS - 1) / NFS_WORD_BITS;
+    int start = (goal >= 0 && goal < bm->bits) ? goal : bm->cursor;
+    int word = start / NFS_WORD_BITS;
+    uint64_t free_bits;
+    int i, idx;
+
+    // 多走一次，回到起始字时再找start之前的位
+    for (i = 0; i <= nwords && nwords > 0; i++, word = (word + 1) % nwords)
+    {
+        free_bits = ~bm->words[word];
+        if (i == 0)
+        {
+            free_bits &= ~0ULL << (start % NFS_WORD_BITS);
+        }
+        if (word == nwords - 1 && bm->bits % NFS_WORD_BITS)
+        {
+            free_bits &= (1ULL << (bm->bits % NFS_WORD_BITS)) - 1;
+        }
+        if (free_bits == 0)
+        {
+            continue;
+        }
+        idx = word * NFS_WORD_BITS + __builtin_ctzll(free_bits);
+        bm->words[word] |= 1ULL << (idx % NFS_WORD_BITS);
+        bm->free_cnt--;
+        bm->cursor = idx + 1 < bm->bits ? idx + 1 : 0;
+        return idx;
+    }
+    return -1;
+}
+
+/**
+ * @brief 释放一位
+ *
+ * @param bm
+ * @param idx
+ */
+void nfs_bitmap_free(struct nfs_bitmap *bm, int idx)
+{
+    uint64_t mask = 1ULL << (idx % NFS_WORD_BITS);
+
+    if (bm->words[idx / NFS_WORD_BITS] & mask)
+    {
+        bm->words[idx / NFS_WORD_BITS] &= ~mask;
+        bm->free_cnt++;
+    }
+}
+
@@ -0,0 +1,538 @@
+#include "../include/newfs.h"
+
+extern struct nfs_super nfs_super;
+
+/**
+ * @brief 初始化新inode的块映射，此时不占用任何数据块；映射方式由inode->flags决定
+ *
+ * @param inode
+ */
+void nfs_bmap_init(struct nfs_inode *inode)
+{
+    int i;
+
+    inode->blk_cnt = 0;
+    inode->extents = NULL;
+    inode->ext_cnt = 0;
+    inode->ext_cap = 0;
+    inode->ext_blks = NULL;
+    inode->ext_blk_cnt = 0;
+    for (i = 0; i < NFS_DIRECT_BLKS; i++)
+    {
+        inode->direct[i] = NFS_INVALID_BNO;
+    }
+    inode->ind = NFS_INVALID_BNO;
+    inode->dind = NFS_INVALID_BNO;
+    inode->ind_map = NULL;
+    inode->dind_map = NULL;
+    inode->dind_leaf = NULL;
+}
+
+/**
+ * @brief 取得一个间接块的内容：已分配的从磁盘读入，未分配且alloc时新分配一块
+ *
+ * @param bno 间接块号，新分配时写回
+ * @param map 返回常驻内存的块内容
+ * @param alloc
+ * @param goal 新分配时期望的块号
+ * @return int
+ */
+static int nfs_bmap_ptr_blk(int *bno, int **map, boolean alloc, int goal)
+{
+    int i;
+
+    if (*bno == NFS_INVALID_BNO)
+    {
+        if (!alloc)
+        {
+            return -NFS_ERROR_NOTFOUND;
+        }
+        *bno = nfs_alloc_data_blk(goal);
+        if (*bno < 0)
+        {
+            int ret = *bno;
+            *bno = NFS_INVALID_BNO;
+            return ret;
+        }
+        *map = (int *)malloc(NFS_BLK_SZ());
+        for (i = 0; i < NFS_PTR_PER_BLK(); i++)
+        {
+            (*map)[i] = NFS_INVALID_BNO;
+        }
+        return NFS_ERROR_NONE;
+    }
+    *map = (int *)malloc(NFS_BLK_SZ());
+    if (nfs_driver_read(NFS_DATA_OFS(*bno), (uint8_t *)*map, NFS_BLK_SZ()) != NFS_ERROR_NONE)
+    {
+        free(*map);
+        *map = NULL;
+        return -NFS_ERROR_IO;
+    }
+    return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 找到逻辑块在直接块、一次间接块或二次间接块中的槽，途经的间接块读入后常驻内存
+ *
+ * @param inode
+ * @param lblk
+ * @param alloc 途经的间接块尚未分配时是否分配
+ * @param goal 新分配间接块时期望的块号
+ * @return int* 槽的地址，超出二次间接范围或间接块不可用时为NULL
+ */
+static int *nfs_bmap_slot(struct nfs_inode *inode, int lblk, boolean alloc, int goal)
+{
+    int per_blk = NFS_PTR_PER_BLK();
+    int leaf;
+
+    if (lblk < NFS_DIRECT_BLKS)
+    {
+        return &inode->direct[lblk];
+    }
+    lblk -= NFS_DIRECT_BLKS;
+    if (lblk < per_blk)
+    {
+        if (inode->ind_map == NULL &&
+            nfs_bmap_ptr_blk(&inode->ind, &inode->ind_map, alloc, goal) != NFS_ERROR_NONE)
+        {
+            return NULL;
+        }
+        return &inode->ind_map[lblk];
+    }
+    lblk -= per_blk;
+    if (lblk >= per_blk * per_blk)
+    {
+        return NULL;
+    }
+    if (inode->dind_map == NULL &&
+        nfs_bmap_ptr_blk(&inode->dind, &inode->dind_map, alloc, goal) != NFS_ERROR_NONE)
+    {
+        return NULL;
+    }
+    if (inode->dind_leaf == NULL)
+    {
+        inode->dind_leaf = (int **)calloc(per_blk, sizeof(int *));
+    }
+    leaf = lblk / per_blk;
+    if (inode->dind_leaf[leaf] == NULL &&
+        nfs_bmap_ptr_blk(&inode->dind_map[leaf], &inode->dind_leaf[leaf], alloc, goal) != NFS_ERROR_NONE)
+    {
+        return NULL;
+    }
+    return &inode->dind_leaf[leaf][lblk % per_blk];
+}
+
+/**
+ * @brief 逻辑块号 -> 数据块号
+ *
+ * @param inode
+ * @param lblk 文件内的逻辑块号
+ * @param run 不为NULL时传入最多需要的块数，返回从lblk起物理连续的块数(不超过传入值)
+ * @return int 数据块号，超出已映射范围时为NFS_INVALID_BNO
+ */
+int nfs_bmap(struct nfs_inode *inode, int lblk, int *run)
+{
+    int base = 0;
+    int *slot;
+    int bno, i, max_run = run ? *run : 0;
+
+    if (lblk < 0 || lblk >= inode->blk_cnt)
+    {
+        return NFS_INVALID_BNO;
+    }
+    if (inode->flags & NFS_INODE_FLAG_INDIRECT)
+    {
+        slot = nfs_bmap_slot(inode, lblk, FALSE, 0);
+        if (slot == NULL)
+        {
+            return NFS_INVALID_BNO;
+        }
+        bno = *slot;
+        if (run)
+        {
+            // 逐个比较后续块号，得到物理连续的长度
+            for (*run = 1; *run < max_run && lblk + *run < inode->blk_cnt; (*run)++)
+            {
+                slot = nfs_bmap_slot(inode, lblk + *run, FALSE, 0);
+                if (slot == NULL || *slot != bno + *run)
+                {
+                    break;
+                }
+            }
+        }
+        return bno;
+    }
+    for (i = 0; i < inode->ext_cnt; i++)
+    {
+        if (lblk < base + inode->extents[i].len)
+        {
+            if (run)
+            {
+                *run = inode->extents[i].len - (lblk - base);
+                *run = *run < max_run ? *run : max_run;
+            }
+            return inode->extents[i].start + (lblk - base);
+        }
+        base += inode->extents[i].len;
+    }
+    return NFS_INVALID_BNO;
+}
+
+/**
+ * @brief 在直接/间接块映射的文件末尾映射一个新数据块，途经的间接块按需分配
+ *
+ * @param inode
+ * @return int 新数据块号，无空闲数据块或超出二次间接范围时返回-NFS_ERROR_NOSPACE
+ */
+static int nfs_bmap_ind_extend(struct nfs_inode *inode)
+{
+    int goal = inode->blk_cnt ? nfs_bmap(inode, inode->blk_cnt - 1, NULL) + 1 : NFS_INVALID_BNO;
+    int *slot;
+    int bno;
+
+    // 先分配途经的间接块，使其紧挨在它所映射的数据块之前
+    slot = nfs_bmap_slot(inode, inode->blk_cnt, TRUE, goal);
+    if (slot == NULL)
+    {
+        return -NFS_ERROR_NOSPACE;
+    }
+    bno = nfs_alloc_data_blk(goal);
+    if (bno < 0)
+    {
+        return bno;
+    }
+    *slot = bno;
+    inode->blk_cnt++;
+    return bno;
+}
+
+/**
+ * @brief 在文件末尾映射一个新数据块。extent映射时优先取紧跟最后一个extent的块，
+ * 使一次顺序写入的文件只占一个extent
+ *
+ * @param inode
+ * @return int 新数据块号，无空闲数据块时返回-NFS_ERROR_NOSPACE，内存不足时返回-NFS_ERROR_NOMEM
+ */
+int nfs_bmap_extend(struct nfs_inode *inode)
+{
+    struct nfs_extent_d *last = inode->ext_cnt ? &inode->extents[inode->ext_cnt - 1] : NULL;
+    int goal = last ? last->start + last->len : NFS_INVALID_BNO;
+    struct nfs_extent_d *extents;
+    int *ext_blks;
+    int bno, ext_bno, ext_cap;
+
+    // 块映射有变化，inode需写回
+    nfs_mark_dirty(inode);
+    if (inode->flags & NFS_INODE_FLAG_INDIRECT)
+    {
+        return nfs_bmap_ind_extend(inode);
+    }
+    bno = nfs_alloc_data_blk(goal);
+    if (bno < 0)
+    {
+        return bno;
+    }
+    if (last && bno == goal)
+    {
+        last->len++;
+        inode->blk_cnt++;
+        return bno;
+    }
+
+    // 需要新extent，先扩容数组，失败时映射保持不变
+    if (inode->ext_cnt == inode->ext_cap)
+    {
+        ext_cap = inode->ext_cap ? inode->ext_cap * 2 : NFS_INLINE_EXTENTS;
+        extents = (struct nfs_extent_d *)realloc(inode->extents, ext_cap * sizeof(struct nfs_extent_d));
+        if (extents == NULL)
+        {
+            nfs_free_data_blk(bno);
+            return -NFS_ERROR_NOMEM;
+        }
+        inode->extents = extents;
+        inode->ext_cap = ext_cap;
+    }
+    // inode内与已有溢出块都放满时再分配一个溢出extent块
+    if (inode->ext_cnt >= NFS_INLINE_EXTENTS + inode->ext_blk_cnt * (int)NFS_EXTENT_PER_BLK())
+    {
+        ext_blks = (int *)realloc(inode->ext_blks, (inode->ext_blk_cnt + 1) * sizeof(int));
+        if (ext_blks == NULL)
+        {
+            nfs_free_data_blk(bno);
+            return -NFS_ERROR_NOMEM;
+        }
+        inode->ext_blks = ext_blks;
+        ext_bno = nfs_alloc_data_blk(NFS_INVALID_BNO);
+        if (ext_bno < 0)
+        {
+            nfs_free_data_blk(bno);
+            return ext_bno;
+        }
+        inode->ext_blks[inode->ext_blk_cnt++] = ext_bno;
+    }
+    inode->extents[inode->ext_cnt].start = bno;
+    inode->extents[inode->ext_cnt].len = 1;
+    inode->ext_cnt++;
+    inode->blk_cnt++;
+    return bno;
+}
+
+/**
+ * @brief 归还一个间接块及其映射的数据块，块号依次填入，遇到NFS_INVALID_BNO即止
+ *
+ * @param bno
+ * @param map 已读入的块内容，为NULL时先读入
+ */
+static void nfs_bmap_free_ptr_blk(int bno, int *map)
+{
+    int i;
+
+    if (map == NULL && nfs_bmap_ptr_blk(&bno, &map, FALSE, 0) != NFS_ERROR_NONE)
+    {
+        return;
+    }
+    for (i = 0; i < NFS_PTR_PER_BLK() && map[i] != NFS_INVALID_BNO; i++)
+    {
+        nfs_free_data_blk(map[i]);
+    }
+    nfs_free_data_blk(bno);
+    free(map);
+}
+
+/**
+ * @brief 归还直接/间接块映射的全部数据块与间接块
+ *
+ * @param inode
+ */
+static void nfs_bmap_ind_release(struct nfs_inode *inode)
+{
+    int i;
+
+    for (i = 0; i < NFS_DIRECT_BLKS && inode->direct[i] != NFS_INVALID_BNO; i++)
+    {
+        nfs_free_data_blk(inode->direct[i]);
+    }
+    if (inode->ind != NFS_INVALID_BNO)
+    {
+        nfs_bmap_free_ptr_blk(inode->ind, inode->ind_map);
+    }
+    if (inode->dind != NFS_INVALID_BNO &&
+        (inode->dind_map != NULL || nfs_bmap_ptr_blk(&inode->dind, &inode->dind_map, FALSE, 0) == NFS_ERROR_NONE))
+    {
+        for (i = 0; i < NFS_PTR_PER_BLK() && inode->dind_map[i] != NFS_INVALID_BNO; i++)
+        {
+            nfs_bmap_free_ptr_blk(inode->dind_map[i], inode->dind_leaf ? inode->dind_leaf[i] : NULL);
+        }
+        nfs_free_data_blk(inode->dind);
+        free(inode->dind_map);
+    }
+    free(inode->dind_leaf);
+    nfs_bmap_init(inode);
+}
+
+/**
+ * @brief 归还inode映射的全部数据块(及溢出extent块或间接块)，并释放映射所占内存
+ *
+ * @param inode
+ */
+void nfs_bmap_release(struct nfs_inode *inode)
+{
+    int i, j;
+
+    if (inode->flags & NFS_INODE_FLAG_INDIRECT)
+    {
+        nfs_bmap_ind_release(inode);
+        return;
+    }
+    for (i = 0; i < inode->ext_cnt; i++)
+    {
+        for (j = 0; j < inode->extents[i].len; j++)
+        {
+            nfs_free_data_blk(inode->extents[i].start + j);
+        }
+    }
+    for (i = 0; i < inode->ext_blk_cnt; i++)
+    {
+        nfs_free_data_blk(inode->ext_blks[i]);
+    }
+    free(inode->extents);
+    free(inode->ext_blks);
+    nfs_bmap_init(inode);
+}
+
+/**
+ * @brief 从磁盘inode读入块映射：extent映射时inode内的extent之后沿溢出extent块链表继续读
+ *
+ * @param inode
+ * @param inode_d
+ * @return int
+ */
+int nfs_bmap_load(struct nfs_inode *inode, struct nfs_inode_d *inode_d)
+{
+    struct nfs_extent_blk_d *ext_blk_d;
+    uint8_t *blk_buf;
+    int *ext_blks;
+    int bno = inode_d->ext_blk;
+    int cnt;
+
+    nfs_bmap_init(inode);
+    inode->flags = inode_d->flags;
+    inode->blk_cnt = inode_d->blk_cnt;
+    if (inode->flags & NFS_INODE_FLAG_INDIRECT)
+    {
+        // 间接块在首次用到时才读入
+        memcpy(inode->direct, inode_d->map.blk.direct, sizeof(inode->direct));
+        inode->ind = inode_d->map.blk.ind;
+        inode->dind = inode_d->map.blk.dind;
+        return NFS_ERROR_NONE;
+    }
+    if (inode_d->ext_cnt == 0)
+    {
+        return NFS_ERROR_NONE;
+    }
+    inode->ext_cap = inode_d->ext_cnt > NFS_INLINE_EXTENTS ? inode_d->ext_cnt : NFS_INLINE_EXTENTS;
+    inode->extents = (struct nfs_extent_d *)malloc(inode->ext_cap * sizeof(struct nfs_extent_d));
+    if (inode->extents == NULL)
+    {
+        return -NFS_ERROR_NOMEM;
+    }
+    cnt = inode_d->ext_cnt < NFS_INLINE_EXTENTS ? inode_d->ext_cnt : NFS_INLINE_EXTENTS;
+    memcpy(inode->extents, inode_d->map.ext, cnt * sizeof(struct nfs_extent_d));
+    inode->ext_cnt = cnt;
+    if (bno == NFS_INVALID_BNO)
+    {
+        return NFS_ERROR_NONE;
+    }
+
+    blk_buf = (uint8_t *)malloc(NFS_BLK_SZ());
+    if (blk_buf == NULL)
+    {
+        return -NFS_ERROR_NOMEM;
+    }
+    ext_blk_d = (struct nfs_extent_blk_d *)blk_buf;
+    while (bno != NFS_INVALID_BNO && inode->ext_cnt < inode_d->ext_cnt)
+    {
+        if (nfs_driver_read(NFS_DATA_OFS(bno), blk_buf, NFS_BLK_SZ()) != NFS_ERROR_NONE)
+        {
+            free(blk_buf);
+            return -NFS_ERROR_IO;
+        }
+        ext_blks = (int *)realloc(inode->ext_blks, (inode->ext_blk_cnt + 1) * sizeof(int));
+        if (ext_blks == NULL)
+        {
+            free(blk_buf);
+            return -NFS_ERROR_NOMEM;
+        }
+        inode->ext_blks = ext_blks;
+        inode->ext_blks[inode->ext_blk_cnt++] = bno;
+        cnt = ext_blk_d->cnt;
+        if (cnt > inode_d->ext_cnt - inode->ext_cnt)
+        {
+            cnt = inode_d->ext_cnt - inode->ext_cnt;
+        }
+        memcpy(inode->extents + inode->ext_cnt, blk_buf + sizeof(struct nfs_extent_blk_d),
+               cnt * sizeof(struct nfs_extent_d));
+        inode->ext_cnt += cnt;
+        bno = ext_blk_d->next;
+    }
+    free(blk_buf);
+    return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 将直接/间接块映射填入磁盘inode，并写回内存中的各间接块
+ *
+ * @param inode
+ * @param inode_d
+ * @return int
+ */
+static int nfs_bmap_ind_store(struct nfs_inode *inode, struct nfs_inode_d *inode_d)
+{
+    int i;
+
+    memcpy(inode_d->map.blk.direct, inode->direct, sizeof(inode->direct));
+    inode_d->map.blk.ind = inode->ind;
+    inode_d->map.blk.dind = inode->dind;
+    if (inode->ind_map != NULL &&
+        nfs_driver_write(NFS_DATA_OFS(inode->ind), (uint8_t *)inode->ind_map, NFS_BLK_SZ()) != NFS_ERROR_NONE)
+    {
+        return -NFS_ERROR_IO;
+    }
+    if (inode->dind_map == NULL)
+    {
+        return NFS_ERROR_NONE;
+    }
+    if (nfs_driver_write(NFS_DATA_OFS(inode->dind), (uint8_t *)inode->dind_map, NFS_BLK_SZ()) != NFS_ERROR_NONE)
+    {
+        return -NFS_ERROR_IO;
+    }
+    for (i = 0; inode->dind_leaf && i < NFS_PTR_PER_BLK(); i++)
+    {
+        if (inode->dind_leaf[i] != NULL &&
+            nfs_driver_write(NFS_DATA_OFS(inode->dind_map[i]), (uint8_t *)inode->dind_leaf[i],
+                             NFS_BLK_SZ()) != NFS_ERROR_NONE)
+        {
+            return -NFS_ERROR_IO;
+        }
+    }
+    return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 将块映射填入磁盘inode：extent映射时放不下的extent写入溢出extent块
+ *
+ * @param inode
+ * @param inode_d
+ * @return int
+ */
+int nfs_bmap_store(struct nfs_inode *inode, struct nfs_inode_d *inode_d)
+{
+    struct nfs_extent_blk_d *ext_blk_d;
+    uint8_t *blk_buf;
+    int per_blk = NFS_EXTENT_PER_BLK();
+    int done, cnt, i;
+
+    inode_d->flags = inode->flags;
+    inode_d->blk_cnt = inode->blk_cnt;
+    inode_d->ext_cnt = inode->ext_cnt;
+    inode_d->ext_blk = inode->ext_blk_cnt ? inode->ext_blks[0] : NFS_INVALID_BNO;
+    memset(&inode_d->map, 0, sizeof(inode_d->map));
+    if (inode->flags & NFS_INODE_FLAG_INDIRECT)
+    {
+        return nfs_bmap_ind_store(inode, inode_d);
+    }
+    cnt = inode->ext_cnt < NFS_INLINE_EXTENTS ? inode->ext_cnt : NFS_INLINE_EXTENTS;
+    if (cnt > 0) /* 空文件的extents可能仍为NULL */
+    {
+        memcpy(inode_d->map.ext, inode->extents, cnt * sizeof(struct nfs_extent_d));
+    }
+    if (inode->ext_blk_cnt == 0)
+    {
+        return NFS_ERROR_NONE;
+    }
+
+    blk_buf = (uint8_t *)malloc(NFS_BLK_SZ());
+    if (blk_buf == NULL)
+    {
+        return -NFS_ERROR_NOMEM;
+    }
+    ext_blk_d = (struct nfs_extent_blk_d *)blk_buf;
+    done = cnt;
+    for (i = 0; i < inode->ext_blk_cnt; i++)
+    {
+        cnt = inode->ext_cnt - done < per_blk ? inode->ext_cnt - done : per_blk;
+        memset(blk_buf, 0, NFS_BLK_SZ());
+        ext_blk_d->next = i + 1 < inode->ext_blk_cnt ? inode->ext_blks[i + 1] : NFS_INVALID_BNO;
+        ext_blk_d->cnt = cnt;
+        memcpy(blk_buf + sizeof(struct nfs_extent_blk_d), inode->extents + done,
+               cnt * sizeof(struct nfs_extent_d));
+        if (nfs_driver_write(NFS_DATA_OFS(inode->ext_blks[i]), blk_buf, NFS_BLK_SZ()) != NFS_ERROR_NONE)
+        {
+            free(blk_buf);
+            return -NFS_ERROR_IO;
+        }
+        done += cnt;
+    }
+    free(blk_buf);
+    return NFS_ERROR_NONE;
+}
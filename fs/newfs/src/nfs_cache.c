@@ -0,0 +1,518 @@
+#include "../include/newfs.h"
+
+extern struct nfs_super nfs_super;
+
+/**
+ * @brief 从磁盘读入一个逻辑块
+ *
+ * @param blk 逻辑块号
+ * @param content
+ * @return int
+ */
+static int nfs_cache_dev_read(int blk, uint8_t *content)
+{
+    if (ddriver_pread(NFS_DRIVER(), (char *)content, NFS_BLK_SZ(), NFS_BLKS_SZ(blk)) != NFS_BLK_SZ())
+    {
+        NFS_DBG("[%s] io error\n", __func__);
+        return -NFS_ERROR_IO;
+    }
+    return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 将块号连续的若干缓存块一次写回磁盘
+ *
+ * @param bufs 按块号升序排列且连续的缓存块
+ * @param cnt
+ * @return int
+ */
+static int nfs_cache_dev_write(struct nfs_buf **bufs, int cnt)
+{
+    struct iovec iov[cnt];
+    int i;
+
+    for (i = 0; i < cnt; i++)
+    {
+        iov[i].iov_base = bufs[i]->data;
+        iov[i].iov_len = NFS_BLK_SZ();
+    }
+    if (ddriver_pwritev(NFS_DRIVER(), iov, cnt, NFS_BLKS_SZ(bufs[0]->blk)) != NFS_BLKS_SZ(cnt))
+    {
+        NFS_DBG("[%s] io error\n", __func__);
+        return -NFS_ERROR_IO;
+    }
+    for (i = 0; i < cnt; i++)
+    {
+        bufs[i]->flags &= ~NFS_FLAG_BUF_DIRTY;
+    }
+    nfs_super.cache.writeback_cnt += cnt;
+    return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 异步提交一批请求并等待全部完成，设备延迟相互重叠；
+ * 未能提交的请求退回同步定位读写，结果均记在各请求的res中
+ *
+ * @param reqs
+ * @param nr 不超过DDRIVER_QUEUE_DEPTH
+ */
+static void nfs_cache_dev_batch(struct ddriver_req *reqs, int nr)
+{
+    struct ddriver_req *done[DDRIVER_QUEUE_DEPTH];
+    int submitted, reaped = 0, ret, i;
+
+    submitted = ddriver_submit(NFS_DRIVER(), reqs, nr);
+    if (submitted < 0)
+    {
+        submitted = 0;
+    }
+    while (reaped < submitted)
+    {
+        ret = ddriver_reap(NFS_DRIVER(), done, submitted - reaped, submitted - reaped);
+        if (ret <= 0)
+        {
+            break;
+        }
+        reaped += ret;
+    }
+    for (i = submitted; i < nr; i++)
+    {
+        if (reqs[i].op == DDRIVER_OP_WRITE)
+            reqs[i].res = ddriver_pwritev(NFS_DRIVER(), reqs[i].iov, reqs[i].iovcnt, reqs[i].offset);
+        else
+            reqs[i].res = ddriver_preadv(NFS_DRIVER(), reqs[i].iov, reqs[i].iovcnt, reqs[i].offset);
+    }
+}
+
+static void nfs_cache_lru_unlink(struct nfs_buf *buf)
+{
+    struct nfs_cache *cache = &nfs_super.cache;
+    if (buf->prev)
+        buf->prev->next = buf->next;
+    else
+        cache->lru_head = buf->next;
+    if (buf->next)
+        buf->next->prev = buf->prev;
+    else
+        cache->lru_tail = buf->prev;
+    buf->prev = buf->next = NULL;
+}
+
+static void nfs_cache_lru_push(struct nfs_buf *buf)
+{
+    struct nfs_cache *cache = &nfs_super.cache;
+    buf->prev = NULL;
+    buf->next = cache->lru_head;
+    if (cache->lru_head)
+        cache->lru_head->prev = buf;
+    cache->lru_head = buf;
+    if (cache->lru_tail == NULL)
+        cache->lru_tail = buf;
+}
+
+static void nfs_cache_hash_remove(struct nfs_buf *buf)
+{
+    struct nfs_buf **pos = &nfs_super.cache.hash[NFS_CACHE_HASH(buf->blk)];
+    while (*pos)
+    {
+        if (*pos == buf)
+        {
+            *pos = buf->hnext;
+            break;
+        }
+        pos = &(*pos)->hnext;
+    }
+    buf->hnext = NULL;
+}
+
+static int nfs_cache_cmp_blk(const void *a, const void *b)
+{
+    return (*(struct nfs_buf **)a)->blk - (*(struct nfs_buf **)b)->blk;
+}
+
+static struct nfs_buf *nfs_cache_lookup(int blk)
+{
+    struct nfs_buf *buf = nfs_super.cache.hash[NFS_CACHE_HASH(blk)];
+    while (buf && buf->blk != blk)
+    {
+        buf = buf->hnext;
+    }
+    return buf;
+}
+
+static void nfs_cache_insert(struct nfs_buf *buf)
+{
+    struct nfs_cache *cache = &nfs_super.cache;
+    buf->flags = NFS_FLAG_BUF_OCCUPY;
+    buf->hnext = cache->hash[NFS_CACHE_HASH(buf->blk)];
+    cache->hash[NFS_CACHE_HASH(buf->blk)] = buf;
+    nfs_cache_lru_push(buf);
+}
+
+/**
+ * @brief 取得一个空闲缓存块：未满时新分配，否则换出LRU尾部的块(脏块先写回)。
+ * 新分配失败时同样改为换出
+ *
+ * @return struct nfs_buf* 无块可用时返回NULL，调用者绕过缓存直接读写
+ */
+static struct nfs_buf *nfs_cache_alloc_buf()
+{
+    struct nfs_cache *cache = &nfs_super.cache;
+    struct nfs_buf *buf;
+
+    if (cache->cnt < cache->capacity)
+    {
+        buf = (struct nfs_buf *)malloc(sizeof(struct nfs_buf));
+        if (buf != NULL)
+        {
+            memset(buf, 0, sizeof(struct nfs_buf));
+            buf->data = (uint8_t *)malloc(NFS_BLK_SZ());
+            if (buf->data != NULL)
+            {
+                cache->cnt++;
+                return buf;
+            }
+            free(buf);
+        }
+    }
+
+    buf = cache->lru_tail;
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+    if (NFS_BUF_IS_DIRTY(buf) && nfs_cache_dev_write(&buf, 1) != NFS_ERROR_NONE)
+    {
+        return NULL;
+    }
+    nfs_cache_lru_unlink(buf);
+    nfs_cache_hash_remove(buf);
+    buf->flags = 0;
+    return buf;
+}
+
+/**
+ * @brief 初始化块缓存
+ *
+ * @param capacity 缓存块数，0表示不使用缓存
+ * @return int 哈希表分配失败时返回-NFS_ERROR_NOMEM，此后不使用缓存
+ */
+int nfs_cache_init(int capacity)
+{
+    struct nfs_cache *cache = &nfs_super.cache;
+    memset(cache, 0, sizeof(struct nfs_cache));
+    cache->capacity = capacity < 0 ? 0 : capacity;
+    cache->hash = (struct nfs_buf **)calloc(NFS_CACHE_HASH_SZ, sizeof(struct nfs_buf *));
+    if (cache->hash == NULL)
+    {
+        cache->capacity = 0;
+        return -NFS_ERROR_NOMEM;
+    }
+    return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 按块号取缓存块，并将其移到LRU头部
+ *
+ * @param blk 逻辑块号
+ * @param fill 未命中时是否从磁盘读入块内容，整块覆盖写时可以不读
+ * @return struct nfs_buf* 失败返回NULL
+ */
+struct nfs_buf *nfs_cache_get(int blk, boolean fill)
+{
+    struct nfs_cache *cache = &nfs_super.cache;
+    struct nfs_buf *buf = nfs_cache_lookup(blk);
+
+    if (buf)
+    {
+        cache->hit_cnt++;
+        nfs_cache_lru_unlink(buf);
+        nfs_cache_lru_push(buf);
+        return buf;
+    }
+
+    cache->miss_cnt++;
+    buf = nfs_cache_alloc_buf();
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+    buf->blk = blk;
+    if (!fill)
+    {
+        nfs_super.saved_read_blks++;
+    }
+    else if (nfs_cache_dev_read(blk, buf->data) != NFS_ERROR_NONE)
+    {
+        nfs_cache_lru_push(buf);
+        buf->blk = -1;
+        return NULL;
+    }
+    nfs_cache_insert(buf);
+    return buf;
+}
+
+/**
+ * @brief 只查缓存，不改变LRU顺序与命中统计，未命中时不读入
+ *
+ * @param blk 逻辑块号
+ * @return struct nfs_buf* 未命中返回NULL
+ */
+struct nfs_buf *nfs_cache_find(int blk)
+{
+    return nfs_cache_lookup(blk);
+}
+
+/**
+ * @brief 预读一组块：未缓存的块一次性异步提交，读入后加入缓存
+ *
+ * @param blks 逻辑块号
+ * @param cnt
+ * @return int 读入的块数
+ */
+int nfs_cache_prefetch(const int *blks, int cnt)
+{
+    struct nfs_cache *cache = &nfs_super.cache;
+    struct nfs_buf *bufs[DDRIVER_QUEUE_DEPTH];
+    struct iovec iov[DDRIVER_QUEUE_DEPTH];
+    struct ddriver_req reqs[DDRIVER_QUEUE_DEPTH];
+    int limit = cache->capacity / 2 < DDRIVER_QUEUE_DEPTH ? cache->capacity / 2 : DDRIVER_QUEUE_DEPTH;
+    int nr = 0, loaded = 0, i, j;
+
+    // 在途的块不在LRU中，限制批量以免把缓存取空
+    for (i = 0; i < cnt && nr < limit; i++)
+    {
+        if (nfs_cache_lookup(blks[i]) != NULL)
+        {
+            continue;
+        }
+        for (j = 0; j < nr && bufs[j]->blk != blks[i]; j++)
+            ;
+        if (j < nr)
+        {
+            continue;
+        }
+        bufs[nr] = nfs_cache_alloc_buf();
+        if (bufs[nr] == NULL)
+        {
+            break;
+        }
+        bufs[nr]->blk = blks[i];
+        iov[nr].iov_base = bufs[nr]->data;
+        iov[nr].iov_len = NFS_BLK_SZ();
+        reqs[nr].op = DDRIVER_OP_READ;
+        reqs[nr].iov = &iov[nr];
+        reqs[nr].iovcnt = 1;
+        reqs[nr].offset = NFS_BLKS_SZ(blks[i]);
+        nr++;
+    }
+    if (nr == 0)
+    {
+        return 0;
+    }
+
+    nfs_cache_dev_batch(reqs, nr);
+    for (i = 0; i < nr; i++)
+    {
+        if (reqs[i].res == NFS_BLK_SZ())
+        {
+            nfs_cache_insert(bufs[i]);
+            loaded++;
+        }
+        else
+        {
+            bufs[i]->blk = -1;
+            nfs_cache_lru_push(bufs[i]);
+        }
+    }
+    cache->prefetch_cnt += loaded;
+    return loaded;
+}
+
+/**
+ * @brief 从blk起把相接的未缓存块合成一次定位向量读入缓存，
+ * 用于多块连续读，如读入整个extent
+ *
+ * @param blk 起始逻辑块号，已缓存时直接返回
+ * @param cnt 最多读入的块数
+ * @return int 读入的块数，小于0失败
+ */
+int nfs_cache_readahead(int blk, int cnt)
+{
+    struct nfs_cache *cache = &nfs_super.cache;
+    struct nfs_buf *bufs[DDRIVER_QUEUE_DEPTH];
+    struct iovec iov[DDRIVER_QUEUE_DEPTH];
+    int limit = cache->capacity / 2 < DDRIVER_QUEUE_DEPTH ? cache->capacity / 2 : DDRIVER_QUEUE_DEPTH;
+    int nr, i;
+
+    // 读入的块在插入前不在LRU中，限制批量以免把缓存取空
+    for (nr = 0; nr < cnt && nr < limit && nfs_cache_lookup(blk + nr) == NULL; nr++)
+    {
+        bufs[nr] = nfs_cache_alloc_buf();
+        if (bufs[nr] == NULL)
+        {
+            break;
+        }
+        bufs[nr]->blk = blk + nr;
+        iov[nr].iov_base = bufs[nr]->data;
+        iov[nr].iov_len = NFS_BLK_SZ();
+    }
+    if (nr == 0)
+    {
+        return 0;
+    }
+
+    if (ddriver_preadv(NFS_DRIVER(), iov, nr, NFS_BLKS_SZ(blk)) != NFS_BLKS_SZ(nr))
+    {
+        NFS_DBG("[%s] io error\n", __func__);
+        for (i = 0; i < nr; i++)
+        {
+            bufs[i]->blk = -1;
+            nfs_cache_lru_push(bufs[i]);
+        }
+        return -NFS_ERROR_IO;
+    }
+    for (i = 0; i < nr; i++)
+    {
+        nfs_cache_insert(bufs[i]);
+    }
+    cache->prefetch_cnt += nr;
+    return nr;
+}
+
+/**
+ * @brief 标记缓存块已被修改，换出或flush时写回
+ *
+ * @param buf
+ */
+void nfs_cache_mark_dirty(struct nfs_buf *buf)
+{
+    buf->flags |= NFS_FLAG_BUF_DIRTY;
+}
+
+/**
+ * @brief 逐块同步写回所有脏块，nfs_cache_flush分配不到合并用的数组时使用
+ *
+ * @return int
+ */
+static int nfs_cache_flush_each()
+{
+    struct nfs_buf *buf;
+    int ret = NFS_ERROR_NONE;
+
+    for (buf = nfs_super.cache.lru_head; buf != NULL; buf = buf->next)
+    {
+        if (NFS_BUF_IS_DIRTY(buf) && nfs_cache_dev_write(&buf, 1) != NFS_ERROR_NONE)
+        {
+            ret = -NFS_ERROR_IO;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief 写回所有脏块，按块号排序后将连续的块合并为一个写请求，各请求异步并发提交
+ *
+ * @return int
+ */
+int nfs_cache_flush()
+{
+    struct nfs_cache *cache = &nfs_super.cache;
+    struct nfs_buf **dirty;
+    struct nfs_buf *buf;
+    struct iovec *iov;
+    struct ddriver_req reqs[DDRIVER_QUEUE_DEPTH];
+    int dirty_cnt = 0;
+    int run_start, i, j, k, nr = 0;
+    int ret = NFS_ERROR_NONE;
+
+    if (cache->cnt == 0)
+    {
+        return NFS_ERROR_NONE;
+    }
+
+    dirty = (struct nfs_buf **)malloc(cache->cnt * sizeof(struct nfs_buf *));
+    if (dirty == NULL)
+    {
+        return nfs_cache_flush_each();
+    }
+    for (buf = cache->lru_head; buf != NULL; buf = buf->next)
+    {
+        if (NFS_BUF_IS_DIRTY(buf))
+        {
+            dirty[dirty_cnt++] = buf;
+        }
+    }
+    qsort(dirty, dirty_cnt, sizeof(struct nfs_buf *), nfs_cache_cmp_blk);
+
+    iov = (struct iovec *)malloc((dirty_cnt + 1) * sizeof(struct iovec));
+    if (iov == NULL)
+    {
+        free(dirty);
+        return nfs_cache_flush_each();
+    }
+    for (i = 0; i < dirty_cnt; i++)
+    {
+        iov[i].iov_base = dirty[i]->data;
+        iov[i].iov_len = NFS_BLK_SZ();
+    }
+
+    run_start = 0;
+    for (i = 1; i <= dirty_cnt; i++)
+    {
+        if (i == dirty_cnt || dirty[i]->blk != dirty[i - 1]->blk + 1 ||
+            i - run_start == UIO_MAXIOV)
+        {
+            reqs[nr].op = DDRIVER_OP_WRITE;
+            reqs[nr].iov = iov + run_start;
+            reqs[nr].iovcnt = i - run_start;
+            reqs[nr].offset = NFS_BLKS_SZ(dirty[run_start]->blk);
+            reqs[nr].priv = dirty + run_start;
+            nr++;
+            run_start = i;
+        }
+        if (nr == DDRIVER_QUEUE_DEPTH || (i == dirty_cnt && nr > 0))
+        {
+            nfs_cache_dev_batch(reqs, nr);
+            for (j = 0; j < nr; j++)
+            {
+                if (reqs[j].res != NFS_BLKS_SZ(reqs[j].iovcnt))
+                {
+                    NFS_DBG("[%s] io error\n", __func__);
+                    ret = -NFS_ERROR_IO;
+                    continue;
+                }
+                for (k = 0; k < reqs[j].iovcnt; k++)
+                {
+                    ((struct nfs_buf **)reqs[j].priv)[k]->flags &= ~NFS_FLAG_BUF_DIRTY;
+                }
+                cache->writeback_cnt += reqs[j].iovcnt;
+            }
+            nr = 0;
+        }
+    }
+    free(iov);
+    free(dirty);
+    return ret;
+}
+
+/**
+ * @brief 释放所有缓存块，调用前需先nfs_cache_flush
+ *
+ */
+void nfs_cache_destroy()
+{
+    struct nfs_cache *cache = &nfs_super.cache;
+    struct nfs_buf *buf = cache->lru_head;
+    struct nfs_buf *next;
+
+    while (buf)
+    {
+        next = buf->next;
+        free(buf->data);
+        free(buf);
+        buf = next;
+    }
+    free(cache->hash);
+    memset(cache, 0, sizeof(struct nfs_cache));
+}
@@ -0,0 +1,242 @@
+#include "../include/newfs.h"
+
+extern struct nfs_super nfs_super;
+
+/**
+ * @brief 路径哈希(FNV-1a)
+ *
+ * @param path
+ * @return uint32_t
+ */
+static uint32_t nfs_dcache_hash(const char *path)
+{
+    uint32_t hash = 2166136261u;
+    while (*path)
+    {
+        hash ^= (uint8_t)*path++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void nfs_dcache_lru_unlink(struct nfs_dcache_entry *entry)
+{
+    struct nfs_dcache *dcache = &nfs_super.dcache;
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        dcache->lru_head = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        dcache->lru_tail = entry->prev;
+    entry->prev = entry->next = NULL;
+}
+
+static void nfs_dcache_lru_push(struct nfs_dcache_entry *entry)
+{
+    struct nfs_dcache *dcache = &nfs_super.dcache;
+    entry->prev = NULL;
+    entry->next = dcache->lru_head;
+    if (dcache->lru_head)
+        dcache->lru_head->prev = entry;
+    dcache->lru_head = entry;
+    if (dcache->lru_tail == NULL)
+        dcache->lru_tail = entry;
+}
+
+static struct nfs_dcache_entry *nfs_dcache_find(const char *path, uint32_t hash)
+{
+    struct nfs_dcache *dcache = &nfs_super.dcache;
+    struct nfs_dcache_entry *entry = dcache->hash[hash & (dcache->hash_sz - 1)];
+    while (entry && (entry->hash != hash || strcmp(entry->path, path) != 0))
+    {
+        entry = entry->hnext;
+    }
+    return entry;
+}
+
+/**
+ * @brief 移除一项并放回空闲链表
+ *
+ * @param entry
+ */
+static void nfs_dcache_remove(struct nfs_dcache_entry *entry)
+{
+    struct nfs_dcache *dcache = &nfs_super.dcache;
+    struct nfs_dcache_entry **pos = &dcache->hash[entry->hash & (dcache->hash_sz - 1)];
+
+    while (*pos && *pos != entry)
+    {
+        pos = &(*pos)->hnext;
+    }
+    if (*pos)
+    {
+        *pos = entry->hnext;
+    }
+    nfs_dcache_lru_unlink(entry);
+    free(entry->path);
+    entry->path = NULL;
+    entry->hnext = dcache->free_list;
+    dcache->free_list = entry;
+    dcache->cnt--;
+}
+
+/**
+ * @brief 初始化路径缓存，所有项一次分配
+ *
+ * @param capacity 最多缓存的路径数，0表示不使用
+ * @return int
+ */
+int nfs_dcache_init(int capacity)
+{
+    struct nfs_dcache *dcache = &nfs_super.dcache;
+    int i;
+
+    memset(dcache, 0, sizeof(struct nfs_dcache));
+    dcache->capacity = capacity < 0 ? 0 : capacity;
+    if (dcache->capacity == 0)
+    {
+        return NFS_ERROR_NONE;
+    }
+    dcache->hash_sz = 1;
+    while (dcache->hash_sz < dcache->capacity * 2)
+    {
+        dcache->hash_sz <<= 1;
+    }
+    dcache->hash = (struct nfs_dcache_entry **)calloc(dcache->hash_sz, sizeof(struct nfs_dcache_entry *));
+    dcache->entries = (struct nfs_dcache_entry *)calloc(dcache->capacity, sizeof(struct nfs_dcache_entry));
+    for (i = 0; i < dcache->capacity; i++)
+    {
+        dcache->entries[i].hnext = dcache->free_list;
+        dcache->free_list = &dcache->entries[i];
+    }
+    return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 按完整路径查缓存，命中时只需一次哈希探查
+ *
+ * @param path
+ * @param is_find 命中时返回该路径是否存在
+ * @return struct nfs_dentry* 路径存在时为其dentry，不存在时为其父目录的dentry，未命中返回NULL
+ */
+struct nfs_dentry *nfs_dcache_lookup(const char *path, boolean *is_find)
+{
+    struct nfs_dcache *dcache = &nfs_super.dcache;
+    struct nfs_dcache_entry *entry;
+
+    if (dcache->capacity == 0)
+    {
+        return NULL;
+    }
+    entry = nfs_dcache_find(path, nfs_dcache_hash(path));
+    if (entry == NULL)
+    {
+        dcache->miss_cnt++;
+        return NULL;
+    }
+    dcache->hit_cnt++;
+    nfs_dcache_lru_unlink(entry);
+    nfs_dcache_lru_push(entry);
+    *is_find = entry->is_find;
+    return entry->dentry;
+}
+
+/**
+ * @brief 记录一次路径解析的结果，满时换出最久未用的项
+ *
+ * @param path
+ * @param dentry
+ * @param is_find FALSE时只应缓存最后一级不存在、父目录存在的路径
+ */
+void nfs_dcache_insert(const char *path, struct nfs_dentry *dentry, boolean is_find)
+{
+    struct nfs_dcache *dcache = &nfs_super.dcache;
+    struct nfs_dcache_entry *entry;
+    uint32_t hash;
+    int bucket;
+
+    if (dcache->capacity == 0)
+    {
+        return;
+    }
+    hash = nfs_dcache_hash(path);
+    entry = nfs_dcache_find(path, hash);
+    if (entry)
+    {
+        nfs_dcache_remove(entry);
+    }
+    if (dcache->free_list == NULL)
+    {
+        nfs_dcache_remove(dcache->lru_tail);
+    }
+    entry = dcache->free_list;
+    dcache->free_list = entry->hnext;
+
+    entry->path = strdup(path);
+    entry->hash = hash;
+    entry->dentry = dentry;
+    entry->is_find = is_find;
+    bucket = hash & (dcache->hash_sz - 1);
+    entry->hnext = dcache->hash[bucket];
+    dcache->hash[bucket] = entry;
+    nfs_dcache_lru_push(entry);
+    dcache->cnt++;
+}
+
+/**
+ * @brief 路径的解析结果将要改变时使其失效
+ *
+ * mknod/mkdir只需去掉该路径本身(可能的不存在项)；rmdir、rename的源及被替换的目标目录
+ * 还会使"path/"下的所有项失效，它们或指向被删的dentry，或经过它解析
+ *
+ * @param path
+ * @param subtree 是否一并失效path下的所有路径，需扫描全部缓存项
+ */
+void nfs_dcache_invalidate(const char *path, boolean subtree)
+{
+    struct nfs_dcache *dcache = &nfs_super.dcache;
+    struct nfs_dcache_entry *entry, *next;
+    int len = strlen(path);
+
+    if (dcache->capacity == 0)
+    {
+        return;
+    }
+    entry = nfs_dcache_find(path, nfs_dcache_hash(path));
+    if (entry)
+    {
+        nfs_dcache_remove(entry);
+    }
+    if (!subtree)
+    {
+        return;
+    }
+    for (entry = dcache->lru_head; entry; entry = next)
+    {
+        next = entry->next;
+        if (strncmp(entry->path, path, len) == 0 && entry->path[len] == '/')
+        {
+            nfs_dcache_remove(entry);
+        }
+    }
+}
+
+/**
+ * @brief 释放路径缓存
+ *
+ */
+void nfs_dcache_destroy()
+{
+    struct nfs_dcache *dcache = &nfs_super.dcache;
+    struct nfs_dcache_entry *entry;
+
+    for (entry = dcache->lru_head; entry; entry = entry->next)
+    {
+        free(entry->path);
+    }
+    free(dcache->entries);
+    free(dcache->hash);
+    memset(dcache, 0, sizeof(struct nfs_dcache));
+}
@@ -70,4 +70,29 @@ void nfs_dump_map() {
         }
         printf("\n");
     }
+}
+
+void nfs_dump_stat() {
+    struct ddriver_stats stats;
+    struct nfs_cache *cache = &nfs_super.cache;
+
+    ddriver_ioctl(NFS_DRIVER(), IOC_REQ_DEVICE_STATS, &stats);
+    printf("device: read %lu (%lu B, %lu us), write %lu (%lu B, %lu us), "
+           "seek %lu (%lu sectors, %lu us), saved pre-read blocks %d\n", 
+           stats.read_cnt, stats.read_bytes, stats.read_lat_us, 
+           stats.write_cnt, stats.write_bytes, stats.write_lat_us,
+           stats.seek_cnt, stats.seek_sectors, stats.seek_lat_us, nfs_super.saved_read_blks);
+    printf("device: %.3f s since stats reset\n", 
+           (stats.now_mono_ns - stats.reset_mono_ns) / 1e9);
+    printf("cache: capacity %d, hit %d, miss %d, writeback %d, prefetch %d\n", 
+           cache->capacity, cache->hit_cnt, cache->miss_cnt, cache->writeback_cnt,
+           cache->prefetch_cnt);
+    printf("dcache: capacity %d, cached %d, hit %d, miss %d\n", 
+           nfs_super.dcache.capacity, nfs_super.dcache.cnt, 
+           nfs_super.dcache.hit_cnt, nfs_super.dcache.miss_cnt);
+    printf("sync: inodes %d, dir blocks %d\n", 
+           nfs_super.sync_inode_cnt, nfs_super.sync_dblk_cnt);
+    printf("space: free inodes %d / %d, free blocks %d / %d\n", 
+           nfs_super.inode_bm.free_cnt, nfs_super.max_ino,
+           nfs_super.data_bm.free_cnt, nfs_super.max_data);
 }
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include "../include/newfs.h"
+
+/**
+ * @brief 为open/opendir建立句柄，句柄存入fi->fh，并占用inode的打开计数
+ *
+ * @param inode 已解析出的inode
+ * @return struct nfs_handle* 内存不足时返回NULL
+ */
+struct nfs_handle *nfs_handle_open(struct nfs_inode *inode)
+{
+    struct nfs_handle *handle = (struct nfs_handle *)malloc(sizeof(struct nfs_handle));
+
+    if (handle == NULL)
+    {
+        return NULL;
+    }
+    memset(handle, 0, sizeof(struct nfs_handle));
+    handle->inode = inode;
+    inode->open_cnt++;
+    return handle;
+}
+
+/**
+ * @brief 关闭句柄。最后一个句柄关闭时，释放打开期间已被unlink/rmdir的inode，
+ * 目录则压缩打开期间删除子项留下的空槽
+ *
+ * @param handle
+ */
+void nfs_handle_release(struct nfs_handle *handle)
+{
+    struct nfs_inode *inode = handle->inode;
+    struct nfs_dentry *dentry;
+
+    if (--inode->open_cnt == 0)
+    {
+        if (inode->unlinked)
+        {
+            dentry = inode->dentry;
+            nfs_drop_inode(inode);
+            free(dentry);
+        }
+        else if (NFS_IS_DIR(inode))
+        {
+            nfs_compact_dentrys(inode);
+        }
+    }
+    free(handle);
+}
+
+/**
+ * @brief 顺序访问检测：本次读从上次读结束处开始即为顺序读
+ *
+ * @param handle
+ * @param offset 本次读的文件内偏移
+ * @param size 本次读的字节数
+ * @return boolean 连续顺序读达到NFS_SEQ_THRESHOLD次时为TRUE，应在请求之后预读
+ */
+boolean nfs_handle_seq(struct nfs_handle *handle, off_t offset, int size)
+{
+    if (offset == handle->next_ofs)
+    {
+        handle->seq_cnt++;
+    }
+    else
+    {
+        handle->seq_cnt = 0;
+    }
+    handle->next_ofs = offset + size;
+    return handle->seq_cnt >= NFS_SEQ_THRESHOLD;
+}
@@ -45,75 +45,277 @@ int nfs_calc_lvl(const char *path)
 }
 
 /**
- * @brief 驱动读(按 1024B 读取)
+ * @brief 把[offset, offset + size)对应的对齐区域拆成向量：不完整的首尾块落在中转区，
+ * 中间的整块直接对应content
+ *
+ * @param offset
+ * @param content
+ * @param size
+ * @param iov 至多3项
+ * @param head 返回首块是否经中转区
+ * @param tail 返回尾块是否经中转区
+ * @return int 向量项数
+ */
+static int nfs_driver_raw_iov(off_t offset, uint8_t *content, int size, struct iovec *iov,
+                              boolean *head, boolean *tail)
+{
+    off_t pos = NFS_ROUND_DOWN(offset, NFS_BLK_SZ());
+    off_t end = offset + size;
+    off_t end_aligned = NFS_ROUND_DOWN(end, NFS_BLK_SZ());
+    int nr = 0;
+
+    *head = (offset != pos || size < NFS_BLK_SZ());
+    *tail = FALSE;
+    if (*head)
+    {
+        iov[nr].iov_base = nfs_super.bounce;
+        iov[nr++].iov_len = NFS_BLK_SZ();
+        pos += NFS_BLK_SZ();
+    }
+    if (end_aligned > pos)
+    {
+        iov[nr].iov_base = content + (pos - offset);
+        iov[nr++].iov_len = end_aligned - pos;
+        pos = end_aligned;
+    }
+    if (end > pos)
+    {
+        *tail = TRUE;
+        iov[nr].iov_base = nfs_super.bounce + NFS_BLK_SZ();
+        iov[nr++].iov_len = NFS_BLK_SZ();
+    }
+    return nr;
+}
+
+/**
+ * @brief 绕过块缓存直接读磁盘(按 1024B 读取)，整块直接读入out_content，
+ * 不完整的首尾块经中转区
  *
  * @param offset
  * @param out_content
  * @param size
  * @return int
  */
-int nfs_driver_read(int offset, uint8_t *out_content, int size)
+static int nfs_driver_read_raw(off_t offset, uint8_t *out_content, int size)
 {
-    int offset_aligned = NFS_ROUND_DOWN(offset, NFS_BLK_SZ());
+    off_t offset_aligned = NFS_ROUND_DOWN(offset, NFS_BLK_SZ());
     int bias = offset - offset_aligned;
     int size_aligned = NFS_ROUND_UP((size + bias), NFS_BLK_SZ());
-    uint8_t *temp_content = (uint8_t *)malloc(size_aligned);
-    uint8_t *cur = temp_content;
-    // lseek(NFS_DRIVER(), offset_aligned, SEEK_SET);
-    ddriver_seek(NFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
-    {
-        // read(NFS_DRIVER(), cur, NFS_IO_SZ());
-        ddriver_read(NFS_DRIVER(), cur, NFS_IO_SZ());
-        cur += NFS_IO_SZ();
-        size_aligned -= NFS_IO_SZ();
-    }
-    memcpy(out_content, temp_content + bias, size);
-    free(temp_content);
+    int tail_len = (offset + size) % NFS_BLK_SZ();
+    struct iovec iov[3];
+    boolean head, tail;
+    int nr = nfs_driver_raw_iov(offset, out_content, size, iov, &head, &tail);
+
+    // 一次定位请求读出整段对齐区域
+    if (ddriver_preadv(NFS_DRIVER(), iov, nr, offset_aligned) != size_aligned)
+    {
+        return -NFS_ERROR_IO;
+    }
+    if (head)
+    {
+        memcpy(out_content, nfs_super.bounce + bias,
+               NFS_BLK_SZ() - bias < size ? NFS_BLK_SZ() - bias : size);
+    }
+    if (tail)
+    {
+        memcpy(out_content + size - tail_len, nfs_super.bounce + NFS_BLK_SZ(), tail_len);
+    }
     return NFS_ERROR_NONE;
 }
 
 /**
- * @brief 驱动写
+ * @brief 绕过块缓存直接写磁盘，整块直接从in_content写出，
+ * 不完整的首尾块先读入中转区再覆盖
  *
  * @param offset
  * @param in_content
  * @param size
  * @return int
  */
-int nfs_driver_write(int offset, uint8_t *in_content, int size)
+static int nfs_driver_write_raw(off_t offset, uint8_t *in_content, int size)
 {
-    int offset_aligned = NFS_ROUND_DOWN(offset, NFS_BLK_SZ());
+    off_t offset_aligned = NFS_ROUND_DOWN(offset, NFS_BLK_SZ());
     int bias = offset - offset_aligned;
     int size_aligned = NFS_ROUND_UP((size + bias), NFS_BLK_SZ());
-    uint8_t *temp_content = (uint8_t *)malloc(size_aligned);
-    uint8_t *cur = temp_content;
-    nfs_driver_read(offset_aligned, temp_content, size_aligned);
-    memcpy(temp_content + bias, in_content, size);
+    int blks = size_aligned / NFS_BLK_SZ();
+    int tail_len = (offset + size) % NFS_BLK_SZ();
+    struct iovec iov[3];
+    boolean head, tail;
+    int nr = nfs_driver_raw_iov(offset, in_content, size, iov, &head, &tail);
+    int pre_read = 0;
+
+    // 只预读未被完整覆盖的首尾块
+    if (head)
+    {
+        if (ddriver_pread(NFS_DRIVER(), (char *)nfs_super.bounce, NFS_BLK_SZ(),
+                          offset_aligned) != NFS_BLK_SZ())
+        {
+            return -NFS_ERROR_IO;
+        }
+        memcpy(nfs_super.bounce + bias, in_content,
+               NFS_BLK_SZ() - bias < size ? NFS_BLK_SZ() - bias : size);
+        pre_read++;
+    }
+    if (tail)
+    {
+        if (ddriver_pread(NFS_DRIVER(), (char *)nfs_super.bounce + NFS_BLK_SZ(), NFS_BLK_SZ(),
+                          offset_aligned + size_aligned - NFS_BLK_SZ()) != NFS_BLK_SZ())
+        {
+            return -NFS_ERROR_IO;
+        }
+        memcpy(nfs_super.bounce + NFS_BLK_SZ(), in_content + size - tail_len, tail_len);
+        pre_read++;
+    }
+    nfs_super.saved_read_blks += blks - pre_read;
+
+    // 一次定位请求写回整段对齐区域
+    if (ddriver_pwritev(NFS_DRIVER(), iov, nr, offset_aligned) != size_aligned)
+    {
+        return -NFS_ERROR_IO;
+    }
+    return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 驱动读，经过块缓存，未命中时才访问磁盘
+ *
+ * @param offset
+ * @param out_content
+ * @param size
+ * @return int
+ */
+int nfs_driver_read(off_t offset, uint8_t *out_content, int size)
+{
+    struct nfs_buf *buf;
+    int bias, len;
 
-    // lseek(NFS_DRIVER(), offset_aligned, SEEK_SET);
-    ddriver_seek(NFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
+    if (nfs_super.cache.capacity == 0)
     {
-        // write(NFS_DRIVER(), cur, NFS_IO_SZ());
-        ddriver_write(NFS_DRIVER(), cur, NFS_IO_SZ());
-        cur += NFS_IO_SZ();
-        size_aligned -= NFS_IO_SZ();
+        return nfs_driver_read_raw(offset, out_content, size);
     }
 
-    free(temp_content);
+    while (size > 0)
+    {
+        bias = offset % NFS_BLK_SZ();
+        len = NFS_BLK_SZ() - bias < size ? NFS_BLK_SZ() - bias : size;
+        if (len < size)
+        {
+            // 跨多块时，把从当前块起相接的未命中块一次读入
+            nfs_cache_readahead(offset / NFS_BLK_SZ(), (bias + size + NFS_BLK_SZ() - 1) / NFS_BLK_SZ());
+        }
+        buf = nfs_cache_get(offset / NFS_BLK_SZ(), TRUE);
+        if (buf != NULL)
+        {
+            memcpy(out_content, buf->data + bias, len);
+        }
+        else if (nfs_driver_read_raw(offset, out_content, len) != NFS_ERROR_NONE)
+        { /* 取不到缓存块时绕过缓存 */
+            return -NFS_ERROR_IO;
+        }
+        out_content += len;
+        offset += len;
+        size -= len;
+    }
     return NFS_ERROR_NONE;
 }
 
 /**
- * @brief 为一个inode分配dentry的bro，采用头插法
+ * @brief 驱动写，只修改块缓存并标记为脏，换出或卸载时才写回磁盘
+ *
+ * @param offset
+ * @param in_content
+ * @param size
+ * @return int
+ */
+int nfs_driver_write(off_t offset, uint8_t *in_content, int size)
+{
+    struct nfs_buf *buf;
+    int bias, len;
+
+    if (nfs_super.cache.capacity == 0)
+    {
+        return nfs_driver_write_raw(offset, in_content, size);
+    }
+
+    while (size > 0)
+    {
+        bias = offset % NFS_BLK_SZ();
+        len = NFS_BLK_SZ() - bias < size ? NFS_BLK_SZ() - bias : size;
+        // 整块覆盖时未命中也无需从磁盘读入旧内容
+        buf = nfs_cache_get(offset / NFS_BLK_SZ(), len != NFS_BLK_SZ());
+        if (buf != NULL)
+        {
+            memcpy(buf->data + bias, in_content, len);
+            nfs_cache_mark_dirty(buf);
+        }
+        else if (nfs_driver_write_raw(offset, in_content, len) != NFS_ERROR_NONE)
+        { /* 取不到缓存块时绕过缓存 */
+            return -NFS_ERROR_IO;
+        }
+        in_content += len;
+        offset += len;
+        size -= len;
+    }
+    return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 文件名哈希(FNV-1a)
+ *
+ * @param fname
+ * @return uint32_t
+ */
+static uint32_t nfs_name_hash(const char *fname)
+{
+    uint32_t hash = 2166136261u;
+    while (*fname)
+    {
+        hash ^= (uint8_t)*fname++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief 按桶数sz重建目录的哈希表，子项取自兄弟链表
+ *
+ * @param inode
+ * @param sz 2的幂
+ */
+static void nfs_dhash_resize(struct nfs_inode *inode, int sz)
+{
+    struct nfs_dentry **dhash = (struct nfs_dentry **)calloc(sz, sizeof(struct nfs_dentry *));
+    struct nfs_dentry *dentry_cursor;
+
+    for (dentry_cursor = inode->dentrys; dentry_cursor; dentry_cursor = dentry_cursor->brother)
+    {
+        dentry_cursor->hnext = dhash[dentry_cursor->hash & (sz - 1)];
+        dhash[dentry_cursor->hash & (sz - 1)] = dentry_cursor;
+    }
+    free(inode->dhash);
+    inode->dhash = dhash;
+    inode->dhash_sz = sz;
+}
+
+/**
+ * @brief 将dentry挂入目录：头插兄弟链表，放入末尾的槽，并加入目录哈希表
  *
  * @param inode
  * @param dentry
- * @return int
  */
-int nfs_alloc_dentry(struct nfs_inode *inode, struct nfs_dentry *dentry)
+static void nfs_link_dentry(struct nfs_inode *inode, struct nfs_dentry *dentry)
 {
+    int bucket;
+
+    if (inode->dslots_cnt == inode->dslots_cap)
+    {
+        inode->dslots_cap = inode->dslots_cap ? inode->dslots_cap * 2 : NFS_DIR_HASH_INIT;
+        inode->dslots = (struct nfs_dentry **)realloc(inode->dslots,
+                                                      inode->dslots_cap * sizeof(struct nfs_dentry *));
+    }
+    dentry->slot = inode->dslots_cnt++;
+    inode->dslots[dentry->slot] = dentry;
+
     if (inode->dentrys == NULL)
     {
         inode->dentrys = dentry;
@@ -124,11 +326,75 @@ int nfs_alloc_dentry(struct nfs_inode *inode, struct nfs_dentry *dentry)
         inode->dentrys = dentry;
     }
     inode->dir_cnt++;
+
+    dentry->hash = nfs_name_hash(dentry->fname);
+    if (inode->dir_cnt > inode->dhash_sz)
+    {
+        // 已在兄弟链表中，重建时一并加入
+        nfs_dhash_resize(inode, inode->dhash_sz ? inode->dhash_sz * 2 : NFS_DIR_HASH_INIT);
+    }
+    else
+    {
+        bucket = dentry->hash & (inode->dhash_sz - 1);
+        dentry->hnext = inode->dhash[bucket];
+        inode->dhash[bucket] = dentry;
+    }
+}
+
+/**
+ * @brief 保证目录的下一个槽已有数据块：已有块写满时在末尾映射新块。
+ * 之后的nfs_alloc_dentry不会再因空间不足失败，rename据此先预留再摘下源项
+ *
+ * @param inode 目录inode
+ * @return int 无空闲数据块时返回-NFS_ERROR_NOSPACE，读目录项失败时返回-NFS_ERROR_IO
+ */
+int nfs_reserve_dentry(struct nfs_inode *inode)
+{
+    int blk_cnt;
+
+    if (nfs_read_dentrys(inode) != NFS_ERROR_NONE)
+    {
+        return -NFS_ERROR_IO;
+    }
+    blk_cnt = inode->dslots_cnt / NFS_DENTRY_PER_BLK();
+    if (inode->dslots_cnt % NFS_DENTRY_PER_BLK() == 0 && blk_cnt >= inode->blk_cnt)
+    {
+        // 已有块写满，目录增长时才在末尾映射新块
+        if (nfs_bmap_extend(inode) < 0)
+        {
+            return -NFS_ERROR_NOSPACE;
+        }
+        nfs_mark_dirty(inode);
+    }
+    return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 为一个inode分配dentry的bro，采用头插法，同时加入目录哈希表；
+ * 目录已有的数据块写满时为其分配下一块。新项所在的目录块与目录inode标记为脏
+ *
+ * @param inode
+ * @param dentry
+ * @return int 目录项个数，无空闲数据块时返回-NFS_ERROR_NOSPACE，读目录项失败时返回-NFS_ERROR_IO
+ */
+int nfs_alloc_dentry(struct nfs_inode *inode, struct nfs_dentry *dentry)
+{
+    int ret = nfs_reserve_dentry(inode);
+
+    if (ret != NFS_ERROR_NONE)
+    {
+        return ret;
+    }
+    nfs_link_dentry(inode, dentry);
+    dentry->dirty = TRUE;
+    nfs_mark_dirty(inode);
     return inode->dir_cnt;
 }
 
 /**
- * @brief 将dentry从inode的dentrys中取出
+ * @brief 将dentry从inode的dentrys中取出；最后一个槽的子项移入空出的槽，
+ * 因而只有这两个槽所在的目录块需要写回。目录被opendir期间则只留下空槽，
+ * 其余子项的槽号不变，readdir按槽号续读不会漏项，最后一次releasedir时再压缩
  *
  * @param inode
  * @param dentry
@@ -138,6 +404,8 @@ int nfs_drop_dentry(struct nfs_inode *inode, struct nfs_dentry *dentry)
 {
     boolean is_find = FALSE;
     struct nfs_dentry *dentry_cursor;
+    struct nfs_dentry *last;
+    struct nfs_dentry **pos;
     dentry_cursor = inode->dentrys;
 
     if (dentry_cursor == dentry)
@@ -162,87 +430,543 @@ int nfs_drop_dentry(struct nfs_inode *inode, struct nfs_dentry *dentry)
     {
         return -NFS_ERROR_NOTFOUND;
     }
+
+    pos = &inode->dhash[dentry->hash & (inode->dhash_sz - 1)];
+    while (*pos && *pos != dentry)
+    {
+        pos = &(*pos)->hnext;
+    }
+    if (*pos)
+    {
+        *pos = dentry->hnext;
+    }
+    dentry->hnext = NULL;
+
+    if (inode->open_cnt > 0)
+    {
+        inode->dslots[dentry->slot] = NULL;
+    }
+    else
+    {
+        last = inode->dslots[--inode->dslots_cnt];
+        if (last != dentry)
+        {
+            inode->dslots[dentry->slot] = last;
+            last->slot = dentry->slot;
+            last->dirty = TRUE;
+        }
+    }
     inode->dir_cnt--;
+    nfs_mark_dirty(inode);
     return inode->dir_cnt;
 }
 
 /**
- * @brief 分配一个inode，占用位图
+ * @brief 压缩目录打开期间留下的空槽，子项依次前移，移动过的所在目录块标记为脏
  *
- * @param dentry 该dentry指向分配的inode
- * @return nfs_inode
+ * @param inode 目录inode
  */
-struct nfs_inode *nfs_alloc_inode(struct nfs_dentry *dentry)
+void nfs_compact_dentrys(struct nfs_inode *inode)
 {
-    struct nfs_inode *inode;
-    inode = (struct nfs_inode *)malloc(sizeof(struct nfs_inode));
-    int byte_cursor = 0;
-    int bit_cursor = 0;
-    int ino_cursor = 0; // 记录索引位图空闲位置下标
+    int from, to = 0;
 
-    int bno_cursor = 0;   // 记录数据位图空闲位置下标
-    int data_blk_cnt = 0; // 记录已从数据位图找到多少个空闲位置
+    if (!inode->dentrys_loaded || inode->dslots_cnt == inode->dir_cnt)
+    {
+        return;
+    }
+    for (from = 0; from < inode->dslots_cnt; from++)
+    {
+        if (inode->dslots[from] == NULL)
+        {
+            continue;
+        }
+        if (from != to)
+        {
+            inode->dslots[to] = inode->dslots[from];
+            inode->dslots[to]->slot = to;
+            inode->dslots[to]->dirty = TRUE;
+        }
+        to++;
+    }
+    inode->dslots_cnt = to;
+    nfs_mark_dirty(inode);
+}
 
-    boolean is_find_free_entry = FALSE;
-    boolean is_find_enough_free_data_blk = FALSE;
+/**
+ * @brief 在目录中按完整文件名查找子项，经哈希表一次探查
+ *
+ * @param inode 目录inode
+ * @param fname
+ * @return struct nfs_dentry* 未找到返回NULL
+ */
+struct nfs_dentry *nfs_find_dentry(struct nfs_inode *inode, const char *fname)
+{
+    struct nfs_dentry *dentry_cursor;
+    uint32_t hash;
 
-    // 从索引位图中取空闲
-    for (byte_cursor = 0; byte_cursor < NFS_BLKS_SZ(nfs_super.map_inode_blks);
-         byte_cursor++)
+    if (inode->dhash_sz == 0)
+    {
+        return NULL;
+    }
+    hash = nfs_name_hash(fname);
+    dentry_cursor = inode->dhash[hash & (inode->dhash_sz - 1)];
+    while (dentry_cursor)
+    {
+        if (dentry_cursor->hash == hash && strcmp(dentry_cursor->fname, fname) == 0)
+        {
+            return dentry_cursor;
+        }
+        dentry_cursor = dentry_cursor->hnext;
+    }
+    return NULL;
+}
+
+/**
+ * @brief 分配一个数据块，占用位图；从goal起找空闲块，到末尾后回绕
+ *
+ * @param goal 期望的块号，如文件最后一个数据块的下一块；小于0时从上次分配处接着找
+ * @return int 数据块号，无空闲数据块时返回-NFS_ERROR_NOSPACE
+ */
+int nfs_alloc_data_blk(int goal)
+{
+    int bno = nfs_bitmap_alloc(&nfs_super.data_bm, goal);
+    if (bno < 0)
+    {
+        return -NFS_ERROR_NOSPACE;
+    }
+    nfs_super.sz_usage = NFS_BLKS_SZ(nfs_super.max_data - nfs_super.data_bm.free_cnt);
+    return bno;
+}
+
+/**
+ * @brief 归还一个数据块，清除其位图位
+ *
+ * @param bno
+ */
+void nfs_free_data_blk(int bno)
+{
+    nfs_bitmap_free(&nfs_super.data_bm, bno);
+    nfs_super.sz_usage = NFS_BLKS_SZ(nfs_super.max_data - nfs_super.data_bm.free_cnt);
+}
+
+/**
+ * @brief 读文件一个逻辑块中的一段。数据经块缓存在首次访问时才从磁盘读入，
+ * 缓存满时干净块被换出；未映射的块读出为0
+ *
+ * @param inode
+ * @param lblk 文件内的逻辑块号
+ * @param bias 块内偏移
+ * @param out_content
+ * @param len 不超出该块
+ * @return int
+ */
+int nfs_read_file_blk(struct nfs_inode *inode, int lblk, int bias, uint8_t *out_content, int len)
+{
+    int bno = nfs_bmap(inode, lblk, NULL);
+
+    if (bno == NFS_INVALID_BNO)
+    {
+        memset(out_content, 0, len);
+        return NFS_ERROR_NONE;
+    }
+    return nfs_driver_read(NFS_DATA_OFS(bno) + bias, out_content, len);
+}
+
+/**
+ * @brief 在文件末尾映射新块，直到覆盖[offset, offset + size)。新块中不被该区间
+ * 完整覆盖的先清零，以免读出磁盘上的旧内容
+ *
+ * @param inode
+ * @param offset 文件内偏移
+ * @param size
+ * @return int 无空闲数据块时返回-NFS_ERROR_NOSPACE，已映射的块保留
+ */
+int nfs_map_file(struct nfs_inode *inode, off_t offset, int size)
+{
+    int last = (offset + size - 1) / NFS_BLK_SZ();
+    off_t blk_ofs;
+    int bno;
+
+    while (size > 0 && (int)inode->blk_cnt <= last)
+    {
+        blk_ofs = NFS_BLKS_SZ(inode->blk_cnt);
+        bno = nfs_bmap_extend(inode);
+        if (bno < 0)
+        {
+            return bno;
+        }
+        if (offset <= blk_ofs && offset + size >= blk_ofs + NFS_BLK_SZ())
+        {
+            continue;
+        }
+        if (nfs_driver_write(NFS_DATA_OFS(bno), nfs_super.zero_blk, NFS_BLK_SZ()) != NFS_ERROR_NONE)
+        {
+            return -NFS_ERROR_IO;
+        }
+    }
+    return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 写文件一个逻辑块中的一段，只修改块缓存。块尚未映射时先由nfs_map_file映射
+ *
+ * @param inode
+ * @param lblk 文件内的逻辑块号
+ * @param bias 块内偏移
+ * @param in_content
+ * @param len 不超出该块
+ * @return int 无空闲数据块时返回-NFS_ERROR_NOSPACE
+ */
+int nfs_write_file_blk(struct nfs_inode *inode, int lblk, int bias, uint8_t *in_content, int len)
+{
+    int ret = nfs_map_file(inode, NFS_BLKS_SZ(lblk) + bias, len);
+
+    if (ret != NFS_ERROR_NONE)
     {
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++)
+        return ret;
+    }
+    return nfs_driver_write(NFS_DATA_OFS(nfs_bmap(inode, lblk, NULL)) + bias, in_content, len);
+}
+
+/**
+ * @brief 读文件[offset, offset + size)，不超出文件大小。按物理连续的块段交给nfs_driver_read，
+ * 数据在块缓存与out_content之间直接拷贝，只有未命中的块访问磁盘，且相接的未命中块合成一次读
+ *
+ * @param inode
+ * @param offset 文件内偏移
+ * @param out_content
+ * @param size
+ * @return int 读出的字节数，失败返回负的错误码
+ */
+int nfs_read_file(struct nfs_inode *inode, off_t offset, uint8_t *out_content, int size)
+{
+    int lblk, bias, len, bno, run;
+    int done = 0;
+
+    if (offset >= inode->size)
+    {
+        return 0;
+    }
+    if (offset + size > inode->size)
+    {
+        size = inode->size - offset;
+    }
+
+    while (done < size)
+    {
+        lblk = (offset + done) / NFS_BLK_SZ();
+        bias = (offset + done) % NFS_BLK_SZ();
+        run = (bias + size - done + NFS_BLK_SZ() - 1) / NFS_BLK_SZ();
+        bno = nfs_bmap(inode, lblk, &run);
+        if (bno == NFS_INVALID_BNO)
         {
-            if ((nfs_super.map_inode[byte_cursor] & (0x1 << bit_cursor)) == 0)
+            run = 1;
+        }
+        len = NFS_BLKS_SZ(run) - bias < size - done ? NFS_BLKS_SZ(run) - bias : size - done;
+        if (bno == NFS_INVALID_BNO)
+        {
+            memset(out_content + done, 0, len);
+        }
+        else if (nfs_driver_read(NFS_DATA_OFS(bno) + bias, out_content + done, len) != NFS_ERROR_NONE)
+        {
+            return -NFS_ERROR_IO;
+        }
+        done += len;
+    }
+    return done;
+}
+
+/**
+ * @brief 把文件从offset所在块起的至多blks块中物理连续的一段读入块缓存，用于顺序读时预读
+ *
+ * @param inode
+ * @param offset 文件内偏移
+ * @param blks
+ * @return int 读入的块数，小于0失败
+ */
+int nfs_readahead_file(struct nfs_inode *inode, off_t offset, int blks)
+{
+    int run = blks;
+    int bno;
+
+    if (offset >= inode->size)
+    {
+        return 0;
+    }
+    bno = nfs_bmap(inode, offset / NFS_BLK_SZ(), &run);
+    if (bno == NFS_INVALID_BNO)
+    {
+        return 0;
+    }
+    return nfs_cache_readahead(NFS_DATA_BLK(bno), run);
+}
+
+/**
+ * @brief 写文件[offset, offset + size)：先映射到区间末尾，再按物理连续的块段直接拷入块缓存，
+ * 写后按需扩大文件大小
+ *
+ * @param inode
+ * @param offset 文件内偏移
+ * @param in_content
+ * @param size
+ * @return int 写入的字节数；空间不足时只写已映射的部分，一个字节也未写入时返回负的错误码
+ */
+int nfs_write_file(struct nfs_inode *inode, off_t offset, uint8_t *in_content, int size)
+{
+    int bias, len, bno, run;
+    int ret = nfs_map_file(inode, offset, size);
+    int done = 0;
+
+    if (ret != NFS_ERROR_NONE && offset + size > NFS_BLKS_SZ(inode->blk_cnt))
+    {
+        size = (int)(NFS_BLKS_SZ(inode->blk_cnt) - offset);
+        if (size <= 0)
+        {
+            return ret;
+        }
+    }
+
+    while (done < size)
+    {
+        bias = (offset + done) % NFS_BLK_SZ();
+        run = (bias + size - done + NFS_BLK_SZ() - 1) / NFS_BLK_SZ();
+        bno = nfs_bmap(inode, (offset + done) / NFS_BLK_SZ(), &run);
+        len = NFS_BLKS_SZ(run) - bias < size - done ? NFS_BLKS_SZ(run) - bias : size - done;
+        if (nfs_driver_write(NFS_DATA_OFS(bno) + bias, in_content + done, len) != NFS_ERROR_NONE)
+        {
+            ret = -NFS_ERROR_IO;
+            break;
+        }
+        done += len;
+    }
+
+    if (offset + done > inode->size)
+    {
+        inode->size = offset + done;
+        nfs_mark_dirty(inode);
+    }
+    return done > 0 || size == 0 ? done : ret;
+}
+
+/**
+ * @brief 取文件从offset起的一段，作为FUSE直接传输的端点：已缓存的块指向缓存块，
+ * 相接的未缓存块合成一段指向镜像文件，由FUSE在管道与文件间splice，未映射的块指向全0块
+ *
+ * @param inode
+ * @param offset 文件内偏移，须在已映射范围内或为读
+ * @param size 剩余字节数
+ * @param is_write 写时缓存块标记为脏
+ * @param seg 返回的一段
+ * @return int 该段的字节数，失败返回负的错误码
+ */
+static int nfs_file_seg(struct nfs_inode *inode, off_t offset, int size, boolean is_write,
+                        struct fuse_buf *seg)
+{
+    int bias = offset % NFS_BLK_SZ();
+    int run = (bias + size + NFS_BLK_SZ() - 1) / NFS_BLK_SZ();
+    int bno = nfs_bmap(inode, offset / NFS_BLK_SZ(), &run);
+    struct nfs_buf *buf;
+    int len, i;
+
+    memset(seg, 0, sizeof(struct fuse_buf));
+    seg->fd = -1;
+    len = NFS_BLK_SZ() - bias < size ? NFS_BLK_SZ() - bias : size;
+    if (bno == NFS_INVALID_BNO)
+    {
+        seg->mem = nfs_super.zero_blk + bias;
+        seg->size = len;
+        return len;
+    }
+    if (nfs_cache_find(NFS_DATA_BLK(bno)))
+    {
+        buf = nfs_cache_get(NFS_DATA_BLK(bno), TRUE);
+        if (is_write)
+        {
+            nfs_cache_mark_dirty(buf);
+        }
+        seg->mem = buf->data + bias;
+        seg->size = len;
+        return len;
+    }
+
+    for (i = 1; i < run && nfs_cache_find(NFS_DATA_BLK(bno + i)) == NULL; i++)
+        ;
+    len = NFS_BLKS_SZ(i) - bias < size ? NFS_BLKS_SZ(i) - bias : size;
+    // 镜像上的传输按整块记账，首尾块只传输其中的一部分
+    seg->fd = ddriver_splice(NFS_DRIVER(), NFS_DATA_OFS(bno),
+                             NFS_BLKS_SZ((bias + len + NFS_BLK_SZ() - 1) / NFS_BLK_SZ()), is_write);
+    if (seg->fd < 0)
+    {
+        return -NFS_ERROR_IO;
+    }
+    seg->flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+    seg->pos = NFS_DATA_OFS(bno) + bias;
+    seg->size = len;
+    return len;
+}
+
+/**
+ * @brief 为read_buf构造读文件[offset, offset + size)的bufvec。未缓存的块指向镜像文件，
+ * 由FUSE直接splice，不经拷贝；缓存块与全0块须拷贝到bufvec自有的内存中：
+ * FUSE回复后会free各段的mem，且缓存块在回复前可能被其他请求换出。相邻的内存段合为一段
+ *
+ * @param inode
+ * @param offset 文件内偏移
+ * @param size
+ * @param bufp 返回的bufvec，由FUSE释放
+ * @return int
+ */
+int nfs_read_file_buf(struct nfs_inode *inode, off_t offset, int size, struct fuse_bufvec **bufp)
+{
+    struct fuse_bufvec *bufv;
+    struct fuse_buf *seg, *prev;
+    uint8_t *mem;
+    int max_segs, len, i;
+    int done = 0;
+
+    if (offset >= inode->size)
+    {
+        size = 0;
+    }
+    else if (offset + size > inode->size)
+    {
+        size = inode->size - offset;
+    }
+    // 每块至多一段
+    max_segs = size > 0 ? (offset % NFS_BLK_SZ() + size + NFS_BLK_SZ() - 1) / NFS_BLK_SZ() : 1;
+    bufv = (struct fuse_bufvec *)malloc(sizeof(struct fuse_bufvec) +
+                                        (max_segs - 1) * sizeof(struct fuse_buf));
+    if (bufv == NULL)
+    {
+        return -NFS_ERROR_NOMEM;
+    }
+    *bufv = FUSE_BUFVEC_INIT(0);
+    bufv->count = 0;
+
+    while (done < size)
+    {
+        seg = &bufv->buf[bufv->count];
+        len = nfs_file_seg(inode, offset + done, size - done, FALSE, seg);
+        if (len >= 0 && !(seg->flags & FUSE_BUF_IS_FD))
+        {
+            prev = bufv->count > 0 && !(seg[-1].flags & FUSE_BUF_IS_FD) ? &seg[-1] : NULL;
+            mem = (uint8_t *)realloc(prev ? prev->mem : NULL, (prev ? prev->size : 0) + len);
+            if (mem == NULL)
             {
-                /* 当前ino_cursor位置空闲 */
-                nfs_super.map_inode[byte_cursor] |= (0x1 << bit_cursor);
-                is_find_free_entry = TRUE;
-                break;
+                len = -NFS_ERROR_NOMEM;
+            }
+            else if (prev)
+            {
+                memcpy(mem + prev->size, seg->mem, len);
+                prev->mem = mem;
+                prev->size += len;
+                done += len;
+                continue;
+            }
+            else
+            {
+                memcpy(mem, seg->mem, len);
+                seg->mem = mem;
             }
-            ino_cursor++;
         }
-        if (is_find_free_entry)
+        if (len < 0)
         {
-            break;
+            for (i = 0; i < (int)bufv->count; i++)
+            {
+                free(bufv->buf[i].mem);
+            }
+            free(bufv);
+            return len;
         }
+        bufv->count++;
+        done += len;
     }
+    if (bufv->count == 0)
+    {
+        bufv->count = 1;
+    }
+    *bufp = bufv;
+    return NFS_ERROR_NONE;
+}
 
-    inode->ino = ino_cursor;
+/**
+ * @brief write_buf的实现：先映射到区间末尾，再逐段由fuse_buf_copy从FUSE的缓冲区(可能是管道)
+ * 直接写入缓存块或镜像文件，写后按需扩大文件大小
+ *
+ * @param inode
+ * @param offset 文件内偏移
+ * @param src FUSE传入的数据
+ * @return int 写入的字节数；一个字节也未写入时返回负的错误码
+ */
+int nfs_write_file_buf(struct nfs_inode *inode, off_t offset, struct fuse_bufvec *src)
+{
+    struct fuse_bufvec dst = FUSE_BUFVEC_INIT(0);
+    int size = fuse_buf_size(src);
+    int ret = nfs_map_file(inode, offset, size);
+    int done = 0, len;
 
-    inode->size = 0;
+    if (ret != NFS_ERROR_NONE && offset + size > NFS_BLKS_SZ(inode->blk_cnt))
+    {
+        size = (int)(NFS_BLKS_SZ(inode->blk_cnt) - offset);
+        if (size <= 0)
+        {
+            return ret;
+        }
+    }
 
-    // 从数据位图中取空闲，要取出NFS_DATA_PER_FILE个
-    for (byte_cursor = 0; byte_cursor < NFS_BLKS_SZ(nfs_super.map_data_blks);
-         byte_cursor++)
+    while (done < size)
     {
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++)
+        len = nfs_file_seg(inode, offset + done, size - done, TRUE, &dst.buf[0]);
+        if (len < 0)
         {
-            if ((nfs_super.map_data[byte_cursor] & (0x1 << bit_cursor)) == 0)
-            {
-                /* 当前bno_cursor位置空闲 */
-                nfs_super.map_data[byte_cursor] |= (0x1 << bit_cursor);
-
-                inode->bno[data_blk_cnt++] = bno_cursor;
-                // 判断是否已经取够
-                if (data_blk_cnt == NFS_DATA_PER_FILE)
-                {
-                    is_find_enough_free_data_blk = TRUE;
-                    break;
-                }
-            }
-            bno_cursor++;
+            ret = len;
+            break;
         }
-        if (is_find_enough_free_data_blk)
+        dst.idx = 0;
+        dst.off = 0;
+        // src的当前位置随拷贝前移，下一段从这里继续
+        ret = fuse_buf_copy(&dst, src, 0);
+        if (ret < 0)
+        {
+            break;
+        }
+        done += ret;
+        if (ret < len)
         {
             break;
         }
     }
 
-    if (!is_find_free_entry || ino_cursor == nfs_super.max_ino)
-        return -NFS_ERROR_NOSPACE;
+    if (offset + done > inode->size)
+    {
+        inode->size = offset + done;
+        nfs_mark_dirty(inode);
+    }
+    return done > 0 || size == 0 ? done : (ret < 0 ? ret : -NFS_ERROR_IO);
+}
 
-    if (!is_find_enough_free_data_blk || bno_cursor == nfs_super.max_data)
-        return -NFS_ERROR_NOSPACE;
+/**
+ * @brief 分配一个inode，只占用inode位图；数据块在写入数据或目录项
+ * 写满已有块时才由nfs_bmap_extend映射
+ *
+ * @param dentry 该dentry指向分配的inode
+ * @return nfs_inode 无空闲inode时返回NULL
+ */
+struct nfs_inode *nfs_alloc_inode(struct nfs_dentry *dentry)
+{
+    struct nfs_inode *inode;
+    int ino_cursor; // 索引位图中分配到的下标
+
+    // 从索引位图中取空闲
+    ino_cursor = nfs_bitmap_alloc(&nfs_super.inode_bm, -1);
+    if (ino_cursor < 0)
+        return NULL;
+
+    inode = (struct nfs_inode *)malloc(sizeof(struct nfs_inode));
+    inode->ino = ino_cursor;
+    inode->size = 0;
+    inode->flags = nfs_super.bmap_indirect ? NFS_INODE_FLAG_INDIRECT : 0;
+    nfs_bmap_init(inode);
 
     dentry->inode = inode;
     dentry->ino = inode->ino;
@@ -253,22 +977,65 @@ struct nfs_inode *nfs_alloc_inode(struct nfs_dentry *dentry)
 
     inode->dir_cnt = 0;
     inode->dentrys = NULL;
+    inode->dhash = NULL;
+    inode->dhash_sz = 0;
+    inode->dslots = NULL;
+    inode->dslots_cnt = 0;
+    inode->dslots_cap = 0;
+    inode->dentrys_loaded = TRUE;
+
+    inode->open_cnt = 0;
+    inode->unlinked = FALSE;
+
+    inode->dirty = FALSE;
+    nfs_mark_dirty(inode);
+    return inode;
+}
 
-    // 为文件中的数据块分配内存
-    if (NFS_IS_REG(inode))
+/**
+ * @brief 将inode从脏链表中取出
+ *
+ * @param inode
+ */
+static void nfs_unmark_dirty(struct nfs_inode *inode)
+{
+    if (!inode->dirty)
     {
-        int p_count = 0;
-        for (p_count = 0; p_count < NFS_DATA_PER_FILE; p_count++)
-        {
-            inode->block_pointer[p_count] = (uint8_t *)malloc(NFS_BLK_SZ());
-        }
+        return;
     }
+    if (inode->dirty_prev)
+        inode->dirty_prev->dirty_next = inode->dirty_next;
+    else
+        nfs_super.dirty_head = inode->dirty_next;
+    if (inode->dirty_next)
+        inode->dirty_next->dirty_prev = inode->dirty_prev;
+    inode->dirty_prev = inode->dirty_next = NULL;
+    inode->dirty = FALSE;
+}
 
-    return inode;
+/**
+ * @brief 标记inode需要写回：其元数据、块映射或目录项有变化，加入脏链表
+ *
+ * @param inode
+ */
+void nfs_mark_dirty(struct nfs_inode *inode)
+{
+    if (inode->dirty)
+    {
+        return;
+    }
+    inode->dirty = TRUE;
+    inode->dirty_prev = NULL;
+    inode->dirty_next = nfs_super.dirty_head;
+    if (nfs_super.dirty_head)
+        nfs_super.dirty_head->dirty_prev = inode;
+    nfs_super.dirty_head = inode;
 }
 
 /**
- * @brief 将内存inode及其下方结构全部刷回磁盘
+ * @brief 将一个inode写回磁盘：inode本身、块映射，目录只写回含脏目录项的块，
+ * 每块拼好后一次写入；不再递归写子项，子项若有变化自会在脏链表中。
+ * 普通文件的数据只在块缓存中，随缓存换出或flush写回
  *
  * @param inode
  * @return int
@@ -277,81 +1044,94 @@ int nfs_sync_inode(struct nfs_inode *inode)
 {
     struct nfs_inode_d inode_d;
     struct nfs_dentry *dentry_cursor;
-    struct nfs_dentry_d dentry_d;
+    struct nfs_dentry_d *dentry_d;
     int ino = inode->ino;
+    int per_blk = NFS_DENTRY_PER_BLK();
+    int lblk, slot, end;
+    boolean blk_dirty;
+
+    if (NFS_IS_DIR(inode))
+    {
+        nfs_compact_dentrys(inode); /* 磁盘上的目录项总是连续存放 */
+    }
+    memset(&inode_d, 0, sizeof(struct nfs_inode_d));
     inode_d.ino = ino;
     inode_d.size = inode->size;
-
     inode_d.ftype = inode->dentry->ftype;
     inode_d.dir_cnt = inode->dir_cnt;
 
-    int offset;
-
-    for (int blk_cnt = 0; blk_cnt < NFS_DATA_PER_FILE; blk_cnt++)
-        inode_d.bno[blk_cnt] = inode->bno[blk_cnt];
-
+    if (nfs_bmap_store(inode, &inode_d) != NFS_ERROR_NONE)
+    {
+        NFS_DBG("[%s] io error\n", __func__);
+        return -NFS_ERROR_IO;
+    }
     if (nfs_driver_write(NFS_INO_OFS(ino), (uint8_t *)&inode_d,
                          sizeof(struct nfs_inode_d)) != NFS_ERROR_NONE)
     {
         NFS_DBG("[%s] io error\n", __func__);
         return -NFS_ERROR_IO;
     }
-    /* Cycle 1: 写 INODE */
-    /* Cycle 2: 写 数据 */
-    if (NFS_IS_DIR(inode))
+    nfs_super.sync_inode_cnt++;
+
+    if (NFS_IS_DIR(inode) && inode->dentrys_loaded) /* 未读入的目录项不会有改动 */
     {
-        int blk_cnt = 0;
-        dentry_cursor = inode->dentrys;
+        uint8_t blk_buf[NFS_BLK_SZ()];
 
-        // 共写NFS_DATA_PER_FILE个数据块
-        while (dentry_cursor != NULL && blk_cnt < NFS_DATA_PER_FILE)
+        for (lblk = 0; lblk * per_blk < inode->dir_cnt; lblk++)
         {
-            // 将目录下dentry存入第一个数据块
-            offset = NFS_DATA_OFS(inode->bno[blk_cnt]);
-            // 写一个blk
-            while (dentry_cursor != NULL)
+            end = (lblk + 1) * per_blk < inode->dir_cnt ? (lblk + 1) * per_blk : inode->dir_cnt;
+            blk_dirty = FALSE;
+            for (slot = lblk * per_blk; slot < end && !blk_dirty; slot++)
+                blk_dirty = inode->dslots[slot]->dirty;
+            if (!blk_dirty)
             {
-                memcpy(dentry_d.fname, dentry_cursor->fname, NFS_MAX_FILE_NAME);
-                dentry_d.ftype = dentry_cursor->ftype;
-                dentry_d.ino = dentry_cursor->ino;
-                dentry_d.valid = dentry_cursor->valid;
-                if (nfs_driver_write(offset, (uint8_t *)&dentry_d,
-                                     sizeof(struct nfs_dentry_d)) != NFS_ERROR_NONE)
-                {
-                    NFS_DBG("[%s] io error\n", __func__);
-                    return -NFS_ERROR_IO;
-                }
-
-                if (dentry_cursor->inode != NULL)
-                {
-                    nfs_sync_inode(dentry_cursor->inode);
-                }
+                continue;
+            }
 
-                dentry_cursor = dentry_cursor->brother;
-                offset += sizeof(struct nfs_dentry_d);
-                if (offset + sizeof(struct nfs_dentry_d) > NFS_DATA_OFS(inode->bno[blk_cnt] + 1))
-                    break;
+            // 整块拼好后一次写入，缓存中也无需先读入旧块
+            memset(blk_buf, 0, NFS_BLK_SZ());
+            for (slot = lblk * per_blk; slot < end; slot++)
+            {
+                dentry_cursor = inode->dslots[slot];
+                dentry_d = (struct nfs_dentry_d *)(blk_buf + (slot - lblk * per_blk) * sizeof(struct nfs_dentry_d));
+                memcpy(dentry_d->fname, dentry_cursor->fname, NFS_MAX_FILE_NAME);
+                dentry_d->ftype = dentry_cursor->ftype;
+                dentry_d->ino = dentry_cursor->ino;
+                dentry_d->valid = dentry_cursor->valid;
+                dentry_cursor->dirty = FALSE;
             }
-            blk_cnt++;
-        }
-    }
-    else if (NFS_IS_REG(inode))
-    {
-        for (int blk_cnt = 0; blk_cnt < NFS_DATA_PER_FILE; blk_cnt++)
-        {
-            if (nfs_driver_write(NFS_DATA_OFS(inode->bno[blk_cnt]),
-                                 inode->block_pointer[blk_cnt], NFS_BLK_SZ()) != NFS_ERROR_NONE)
+            if (nfs_driver_write(NFS_DATA_OFS(nfs_bmap(inode, lblk, NULL)), blk_buf,
+                                 NFS_BLK_SZ()) != NFS_ERROR_NONE)
             {
                 NFS_DBG("[%s] io error\n", __func__);
                 return -NFS_ERROR_IO;
             }
+            nfs_super.sync_dblk_cnt++;
+        }
+    }
+    nfs_unmark_dirty(inode);
+    return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 写回脏链表中的全部inode，耗时只与变化量有关，与整棵树的大小无关
+ *
+ * @return int
+ */
+int nfs_sync_dirty()
+{
+    while (nfs_super.dirty_head)
+    {
+        if (nfs_sync_inode(nfs_super.dirty_head) != NFS_ERROR_NONE)
+        {
+            return -NFS_ERROR_IO;
         }
     }
     return NFS_ERROR_NONE;
 }
 
 /**
- * @brief 删除内存中的一个inode， 暂时不释放
+ * @brief 删除一个inode：清除其inode位与数据块位，释放内存
  * Case 1: Reg File
  *
  *                  Inode
@@ -383,11 +1163,7 @@ int nfs_drop_inode(struct nfs_inode *inode)
     struct nfs_dentry *dentry_cursor;
     struct nfs_dentry *dentry_to_free;
     struct nfs_inode *inode_cursor;
-
-    int byte_cursor = 0;
-    int bit_cursor = 0;
-    int ino_cursor = 0;
-    boolean is_find = FALSE;
+    int ret;
 
     if (inode == nfs_super.root_dentry->inode)
     {
@@ -396,46 +1172,184 @@ int nfs_drop_inode(struct nfs_inode *inode)
 
     if (NFS_IS_DIR(inode))
     {
+        if (nfs_read_dentrys(inode) != NFS_ERROR_NONE)
+        {
+            return -NFS_ERROR_IO;
+        }
         dentry_cursor = inode->dentrys;
         /* 递归向下drop */
         while (dentry_cursor)
         {
             inode_cursor = dentry_cursor->inode;
-            nfs_drop_inode(inode_cursor);
+            if (inode_cursor == NULL)
+            {
+                inode_cursor = nfs_read_inode(dentry_cursor, dentry_cursor->ino);
+                if (inode_cursor == NULL)
+                {
+                    return -NFS_ERROR_IO;
+                }
+                dentry_cursor->inode = inode_cursor;
+            }
+            ret = nfs_drop_inode(inode_cursor);
+            if (ret < 0)
+            {
+                return ret;
+            }
             nfs_drop_dentry(inode, dentry_cursor);
             dentry_to_free = dentry_cursor;
             dentry_cursor = dentry_cursor->brother;
             free(dentry_to_free);
         }
+        free(inode->dhash);
+        free(inode->dslots);
+    }
+
+    nfs_bitmap_free(&nfs_super.inode_bm, inode->ino); /* 调整inodemap */
+    nfs_bmap_release(inode); /* 调整datamap */
+    nfs_unmark_dirty(inode);
+
+    inode->dentry->inode = NULL;
+    free(inode);
+    return NFS_ERROR_NONE;
+}
+
+/**
+ * @brief 由已读出的磁盘inode建立内存inode。目录项不在此读入，
+ * 只取磁盘上的目录项个数，readdir填充属性时无需读子目录的目录块
+ *
+ * @param dentry dentry指向该inode
+ * @param inode_d 磁盘上的inode
+ * @return struct nfs_inode* 读盘出错或内存不足时返回NULL，已分配的内存均已释放
+ */
+static struct nfs_inode *nfs_build_inode(struct nfs_dentry *dentry, struct nfs_inode_d *inode_d)
+{
+    struct nfs_inode *inode = (struct nfs_inode *)malloc(sizeof(struct nfs_inode));
+
+    if (inode == NULL)
+    {
+        return NULL;
+    }
+    inode->dir_cnt = inode_d->dir_cnt;
+    inode->ino = inode_d->ino;
+    inode->size = inode_d->size;
+    if (nfs_bmap_load(inode, inode_d) != NFS_ERROR_NONE)
+    {
+        NFS_DBG("[%s] io error\n", __func__);
+        free(inode->extents);
+        free(inode->ext_blks);
+        free(inode);
+        return NULL;
+    }
+
+    inode->dentry = dentry;
+    inode->dentrys = NULL;
+    inode->dhash = NULL;
+    inode->dhash_sz = 0;
+    inode->dslots = NULL;
+    inode->dslots_cnt = 0;
+    inode->dslots_cap = 0;
+    inode->dentrys_loaded = !NFS_IS_DIR(inode) || inode->dir_cnt == 0;
+    inode->open_cnt = 0;
+    inode->unlinked = FALSE;
+    inode->dirty = FALSE;
+    // 普通文件的数据不在此读入，由nfs_read_file_blk/nfs_write_file_blk按块访问时才读
+    return inode;
+}
+
+/**
+ * @brief 读目录项中途失败时撤销已挂入的子项，恢复为未读入状态，下次可重新读
+ *
+ * @param inode 目录inode
+ * @param dir_cnt 磁盘上的目录项个数
+ */
+static void nfs_unload_dentrys(struct nfs_inode *inode, int dir_cnt)
+{
+    struct nfs_dentry *dentry_cursor = inode->dentrys;
+    struct nfs_dentry *dentry_to_free;
+
+    while (dentry_cursor)
+    {
+        dentry_to_free = dentry_cursor;
+        dentry_cursor = dentry_cursor->brother;
+        free(dentry_to_free);
+    }
+    free(inode->dhash);
+    free(inode->dslots);
+    inode->dentrys = NULL;
+    inode->dhash = NULL;
+    inode->dhash_sz = 0;
+    inode->dslots = NULL;
+    inode->dslots_cnt = 0;
+    inode->dslots_cap = 0;
+    inode->dir_cnt = dir_cnt;
+}
+
+/**
+ * @brief 读入目录的全部目录项，已读入时直接返回。目录被查找经过、打开
+ * 或增删子项时才调用，列出父目录时不为每个子目录读盘
+ *
+ * @param inode 目录inode
+ * @return int 读盘出错或内存不足时返回负的错误码，目录保持未读入
+ */
+int nfs_read_dentrys(struct nfs_inode *inode)
+{
+    struct nfs_dentry *sub_dentry;
+    struct nfs_dentry_d *dentry_d;
+    uint8_t blk_buf[NFS_BLK_SZ()];
+    int dir_cnt = inode->dir_cnt;
+    int dir_total = inode->dir_cnt;
+    int blk_cnt = 0;
+    int *blks;
+    int bno, nblks, slot;
+
+    if (inode->dentrys_loaded)
+    {
+        return NFS_ERROR_NONE;
     }
-    else if (NFS_IS_REG(inode))
+
+    // 将目录的数据块一次异步预读进缓存，各块的设备延迟重叠
+    nblks = (dir_cnt + NFS_DENTRY_PER_BLK() - 1) / NFS_DENTRY_PER_BLK();
+    if (nfs_super.cache.capacity > 0 && nblks > 1)
     {
-        for (byte_cursor = 0; byte_cursor < NFS_BLKS_SZ(nfs_super.map_inode_blks);
-             byte_cursor++) /* 调整inodemap */
+        blks = (int *)malloc(nblks * sizeof(int));
+        if (blks != NULL) /* 预读只为重叠延迟，内存不足时跳过 */
         {
-            for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++)
-            {
-                if (ino_cursor == inode->ino)
-                {
-                    nfs_super.map_inode[byte_cursor] &= (uint8_t)(~(0x1 << bit_cursor));
-                    is_find = TRUE;
-                    break;
-                }
-                ino_cursor++;
-            }
-            if (is_find == TRUE)
-            {
-                break;
-            }
+            for (blk_cnt = 0; blk_cnt < nblks; blk_cnt++)
+                blks[blk_cnt] = NFS_DATA_BLK(nfs_bmap(inode, blk_cnt, NULL));
+            nfs_cache_prefetch(blks, nblks);
+            free(blks);
         }
+    }
 
-        for (int p_count = 0; p_count < NFS_DATA_PER_FILE; p_count++)
+    // 每个目录块一次读入，再按槽依次解析；nfs_link_dentry重新计数dir_cnt
+    inode->dir_cnt = 0;
+    blk_cnt = 0;
+    while (dir_cnt != 0)
+    {
+        bno = nfs_bmap(inode, blk_cnt, NULL);
+        if (nfs_driver_read(NFS_DATA_OFS(bno), blk_buf, NFS_BLK_SZ()) != NFS_ERROR_NONE)
         {
-            free(inode->block_pointer[p_count]);
+            NFS_DBG("[%s] io error\n", __func__);
+            nfs_unload_dentrys(inode, dir_total);
+            return -NFS_ERROR_IO;
         }
 
-        free(inode);
+        for (slot = 0; slot < NFS_DENTRY_PER_BLK() && dir_cnt != 0; slot++, dir_cnt--)
+        {
+            dentry_d = (struct nfs_dentry_d *)(blk_buf + slot * sizeof(struct nfs_dentry_d));
+            sub_dentry = new_dentry(dentry_d->fname, dentry_d->ftype);
+            if (sub_dentry == NULL)
+            {
+                nfs_unload_dentrys(inode, dir_total);
+                return -NFS_ERROR_NOMEM;
+            }
+            sub_dentry->parent = inode->dentry;
+            sub_dentry->ino = dentry_d->ino;
+            nfs_link_dentry(inode, sub_dentry);
+        }
+        blk_cnt++;
     }
+    inode->dentrys_loaded = TRUE;
     return NFS_ERROR_NONE;
 }
 
@@ -448,12 +1362,7 @@ int nfs_drop_inode(struct nfs_inode *inode)
  */
 struct nfs_inode *nfs_read_inode(struct nfs_dentry *dentry, int ino)
 {
-    struct nfs_inode *inode = (struct nfs_inode *)malloc(sizeof(struct nfs_inode));
     struct nfs_inode_d inode_d;
-    struct nfs_dentry *sub_dentry;
-    struct nfs_dentry_d dentry_d;
-    int blk_cnt = 0;
-    int dir_cnt = 0, offset;
 
     if (nfs_driver_read(NFS_INO_OFS(ino), (uint8_t *)&inode_d,
                         sizeof(struct nfs_inode_d)) != NFS_ERROR_NONE)
@@ -461,84 +1370,122 @@ struct nfs_inode *nfs_read_inode(struct nfs_dentry *dentry, int ino)
         NFS_DBG("[%s] io error\n", __func__);
         return NULL;
     }
-    inode->dir_cnt = 0;
-    inode->ino = inode_d.ino;
-    inode->size = inode_d.size;
+    return nfs_build_inode(dentry, &inode_d);
+}
 
-    for (blk_cnt = 0; blk_cnt < NFS_DATA_PER_FILE; blk_cnt++)
-        inode->bno[blk_cnt] = inode_d.bno[blk_cnt];
+static int nfs_dentry_ino_cmp(const void *a, const void *b)
+{
+    return (*(struct nfs_dentry *const *)a)->ino - (*(struct nfs_dentry *const *)b)->ino;
+}
 
-    inode->dentry = dentry;
-    inode->dentrys = NULL;
+/**
+ * @brief 批量载入目录中从第from项起尚未载入的子inode。按ino排序后顺序扫描inode表，
+ * 每个inode表块只读一次，供readdir直接填充属性，避免随后逐项getattr各自读盘。
+ * 子目录只建立inode，其目录项仍等到被查找或打开时才读
+ *
+ * @param inode 目录inode
+ * @param from 起始槽号
+ * @return int 载入的inode数，出错时返回负的错误码
+ */
+int nfs_load_dir_inodes(struct nfs_inode *inode, int from)
+{
+    struct nfs_dentry **pending;
+    struct nfs_dentry *sub_dentry;
+    struct nfs_inode_d *inode_d;
+    uint8_t blk_buf[NFS_BLK_SZ()];
+    int *blks;
+    int cnt = 0, nblks = 0, cur_blk = -1;
+    int i;
 
-    if (NFS_IS_DIR(inode))
+    if (!NFS_IS_DIR(inode))
     {
-        dir_cnt = inode_d.dir_cnt;
-        blk_cnt = 0;
-
-        while (dir_cnt != 0)
+        return 0;
+    }
+    if (nfs_read_dentrys(inode) != NFS_ERROR_NONE)
+    {
+        return -NFS_ERROR_IO;
+    }
+    if (from >= inode->dslots_cnt)
+    {
+        return 0;
+    }
+    pending = (struct nfs_dentry **)malloc((inode->dslots_cnt - from) * sizeof(struct nfs_dentry *));
+    if (pending == NULL)
+    {
+        return -NFS_ERROR_NOMEM;
+    }
+    for (i = from; i < inode->dslots_cnt; i++)
+    {
+        sub_dentry = nfs_get_dentry(inode, i);
+        if (sub_dentry && sub_dentry->inode == NULL)
         {
-            offset = NFS_DATA_OFS(inode->bno[blk_cnt]);
+            pending[cnt++] = sub_dentry;
+        }
+    }
+    if (cnt == 0)
+    {
+        free(pending);
+        return 0;
+    }
+    qsort(pending, cnt, sizeof(struct nfs_dentry *), nfs_dentry_ino_cmp);
 
-            while (offset + sizeof(struct nfs_dentry_d) < NFS_DATA_OFS(inode->bno[blk_cnt] + 1))
+    // 涉及的inode表块一次异步预读进缓存，各块的设备延迟重叠
+    if (nfs_super.cache.capacity > 0 && cnt > 1)
+    {
+        blks = (int *)malloc(cnt * sizeof(int));
+        if (blks != NULL) /* 预读只为重叠延迟，内存不足时跳过 */
+        {
+            for (i = 0; i < cnt; i++)
             {
-                if (nfs_driver_read(offset, (uint8_t *)&dentry_d,
-                                    sizeof(struct nfs_dentry_d)) != NFS_ERROR_NONE)
+                if (nblks == 0 || blks[nblks - 1] != NFS_INO_BLK(pending[i]->ino))
                 {
-                    NFS_DBG("[%s] io error\n", __func__);
-                    return NULL;
+                    blks[nblks++] = NFS_INO_BLK(pending[i]->ino);
                 }
-
-                sub_dentry = new_dentry(dentry_d.fname, dentry_d.ftype);
-                sub_dentry->parent = inode->dentry;
-                sub_dentry->ino = dentry_d.ino;
-                nfs_alloc_dentry(inode, sub_dentry);
-
-                offset += sizeof(struct nfs_dentry_d);
-                dir_cnt--;
-                if (dir_cnt == 0)
-                    break;
             }
-            blk_cnt++;
+            nfs_cache_prefetch(blks, nblks);
+            free(blks);
         }
     }
-    else if (NFS_IS_REG(inode))
+
+    for (i = 0; i < cnt; i++)
     {
-        for (blk_cnt = 0; blk_cnt < NFS_DATA_PER_FILE; blk_cnt++)
+        sub_dentry = pending[i];
+        if (NFS_INO_BLK(sub_dentry->ino) != cur_blk)
         {
-            inode->block_pointer[blk_cnt] = (uint8_t *)malloc(NFS_BLK_SZ());
-            if (nfs_driver_read(NFS_DATA_OFS(inode->bno[blk_cnt]), inode->block_pointer[blk_cnt],
-                                NFS_BLK_SZ()) != NFS_ERROR_NONE)
+            cur_blk = NFS_INO_BLK(sub_dentry->ino);
+            if (nfs_driver_read(NFS_BLKS_SZ(cur_blk), blk_buf, NFS_BLK_SZ()) != NFS_ERROR_NONE)
             {
                 NFS_DBG("[%s] io error\n", __func__);
-                return NULL;
+                free(pending);
+                return -NFS_ERROR_IO;
             }
         }
+        inode_d = (struct nfs_inode_d *)(blk_buf + NFS_INO_OFS(sub_dentry->ino) % NFS_BLK_SZ());
+        sub_dentry->inode = nfs_build_inode(sub_dentry, inode_d);
+        if (sub_dentry->inode == NULL)
+        {
+            free(pending);
+            return -NFS_ERROR_IO;
+        }
     }
-    return inode;
+    free(pending);
+    return cnt;
 }
 
 /**
- * @brief
+ * @brief 按槽号取目录项，槽号与目录项在磁盘上的位置一致，O(1)
  *
  * @param inode
- * @param dir [0...]
- * @return struct nfs_dentry*
+ * @param dir [0...dslots_cnt)
+ * @return struct nfs_dentry* 越界或该槽为目录打开期间删除留下的空槽时返回NULL
  */
 struct nfs_dentry *nfs_get_dentry(struct nfs_inode *inode, int dir)
 {
-    struct nfs_dentry *dentry_cursor = inode->dentrys;
-    int cnt = 0;
-    while (dentry_cursor)
+    if (dir < 0 || dir >= inode->dslots_cnt)
     {
-        if (dir == cnt)
-        {
-            return dentry_cursor;
-        }
-        cnt++;
-        dentry_cursor = dentry_cursor->brother;
+        return NULL;
     }
-    return NULL;
+    return inode->dslots[dir];
 }
 
 /**
@@ -553,40 +1500,66 @@ struct nfs_dentry *nfs_get_dentry(struct nfs_inode *inode, int dir)
  *      1) find /'s inode       lvl = 1
  *      2) find qwe's dentry
  *
+ * 先查路径缓存，命中则一次哈希探查即得结果；未命中时逐级解析，
+ * 并缓存找到的路径及最后一级不存在的路径(供随后的mknod/mkdir使用)
+ *
  * @param path
- * @return struct nfs_inode*
+ * @return struct nfs_dentry* 沿途inode读盘出错或内存不足时返回NULL，is_find置为FALSE
  */
 struct nfs_dentry *nfs_lookup(const char *path, boolean *is_find, boolean *is_root)
 {
     struct nfs_dentry *dentry_cursor = nfs_super.root_dentry;
     struct nfs_dentry *dentry_ret = NULL;
+    struct nfs_dentry *dentry_hit;
     struct nfs_inode *inode;
     int total_lvl = nfs_calc_lvl(path);
     int lvl = 0;
-    boolean is_hit;
+    boolean is_cacheable = FALSE;
     char *fname = NULL;
-    char *path_cpy = (char *)malloc(sizeof(path));
+    char *path_cpy;
     *is_root = FALSE;
-    strcpy(path_cpy, path);
+    *is_find = FALSE;
 
     if (total_lvl == 0)
     { /* 根目录 */
         *is_find = TRUE;
         *is_root = TRUE;
-        dentry_ret = nfs_super.root_dentry;
+        return nfs_super.root_dentry;
+    }
+    dentry_ret = nfs_dcache_lookup(path, is_find);
+    if (dentry_ret != NULL)
+    {
+        if (dentry_ret->inode == NULL)
+        {
+            dentry_ret->inode = nfs_read_inode(dentry_ret, dentry_ret->ino);
+            if (dentry_ret->inode == NULL)
+            {
+                *is_find = FALSE;
+                return NULL;
+            }
+        }
+        return dentry_ret;
     }
+
+    path_cpy = strdup(path);
     fname = strtok(path_cpy, "/");
     while (fname)
     {
         lvl++;
         if (dentry_cursor->inode == NULL)
         { /* Cache机制 */
-            nfs_read_inode(dentry_cursor, dentry_cursor->ino);
+            dentry_cursor->inode = nfs_read_inode(dentry_cursor, dentry_cursor->ino);
+            if (dentry_cursor->inode == NULL)
+            {
+                NFS_DBG("[%s] io error\n", __func__);
+                dentry_ret = NULL;
+                break;
+            }
         }
 
         inode = dentry_cursor->inode;
 
-        if (NFS_IS_REG(inode) && lvl < total_lvl)
+        if (NFS_IS_REG(inode))
         {
             NFS_DBG("[%s] not a dir\n", __func__);
             dentry_ret = inode->dentry;
@@ -594,41 +1567,49 @@ struct nfs_dentry *nfs_lookup(const char *path, boolean *is_find, boolean *is_ro
         }
         if (NFS_IS_DIR(inode))
         {
-            dentry_cursor = inode->dentrys;
-            is_hit = FALSE;
-
-            while (dentry_cursor)
+            if (nfs_read_dentrys(inode) != NFS_ERROR_NONE)
             {
-                if (memcmp(dentry_cursor->fname, fname, strlen(fname)) == 0)
-                {
-                    is_hit = TRUE;
-                    break;
-                }
-                dentry_cursor = dentry_cursor->brother;
+                NFS_DBG("[%s] io error\n", __func__);
+                dentry_ret = inode->dentry;
+                break;
             }
+            dentry_hit = nfs_find_dentry(inode, fname);
 
-            if (!is_hit)
+            if (dentry_hit == NULL)
             {
                 *is_find = FALSE;
                 NFS_DBG("[%s] not found %s\n", __func__, fname);
                 dentry_ret = inode->dentry;
+                is_cacheable = (lvl == total_lvl);
                 break;
             }
 
-            if (is_hit && lvl == total_lvl)
+            dentry_cursor = dentry_hit;
+            if (lvl == total_lvl)
             {
                 *is_find = TRUE;
                 dentry_ret = dentry_cursor;
+                is_cacheable = TRUE;
                 break;
             }
         }
         fname = strtok(NULL, "/");
     }
+    free(path_cpy);
 
-    if (dentry_ret->inode == NULL)
+    if (dentry_ret != NULL && dentry_ret->inode == NULL)
     {
         dentry_ret->inode = nfs_read_inode(dentry_ret, dentry_ret->ino);
     }
+    if (dentry_ret == NULL || dentry_ret->inode == NULL)
+    { /* 读盘出错或内存不足，不缓存 */
+        *is_find = FALSE;
+        return NULL;
+    }
+    if (is_cacheable)
+    {
+        nfs_dcache_insert(path, dentry_ret, *is_find);
+    }
 
     return dentry_ret;
 }
@@ -637,11 +1618,12 @@ struct nfs_dentry *nfs_lookup(const char *path, boolean *is_find, boolean *is_ro
  * @brief 挂载nfs, Layout 如下
  *
  * Layout
- * | Super | Inode Map | Data Map | Data |
+ * | Super | Inode Map | Data Map | Inode | Data |
  *
  *  BLK_SZ = 2 * IO_SZ
  *
- * 每个Inode占用一个Blk
+ * 每块存放NFS_INODE_PER_BLK()个Inode，相邻Inode的读写落在同一块上，
+ * 经块缓存只需一次IO；Inode表之外剩余的块全部作为数据块
  * @param options
  * @return int
  */
@@ -653,8 +1635,11 @@ int nfs_mount(struct custom_options options)
     struct nfs_dentry *root_dentry;
     struct nfs_inode *root_inode;
 
+    uint64_t total_blks;
     int inode_num;
+    int inode_blks;
     int map_inode_blks;
+    uint64_t rest_blks;
     int data_num;
     int map_data_blks;
 
@@ -662,6 +1647,10 @@ int nfs_mount(struct custom_options options)
     boolean is_init = FALSE;
 
     nfs_super.is_mounted = FALSE;
+    nfs_super.saved_read_blks = 0;
+    nfs_super.dirty_head = NULL;
+    nfs_super.sync_inode_cnt = 0;
+    nfs_super.sync_dblk_cnt = 0;
 
     // driver_fd = open(options.device, O_RDWR);
     driver_fd = ddriver_open(options.device);
@@ -672,11 +1661,20 @@ int nfs_mount(struct custom_options options)
     }
 
     nfs_super.fd = driver_fd;
-    ddriver_ioctl(NFS_DRIVER(), IOC_REQ_DEVICE_SIZE, &nfs_super.sz_disk);
+    ddriver_ioctl(NFS_DRIVER(), IOC_REQ_DEVICE_SIZE64, &nfs_super.sz_disk);
     ddriver_ioctl(NFS_DRIVER(), IOC_REQ_DEVICE_IO_SZ, &nfs_super.sz_io);
     nfs_super.sz_blk = nfs_super.sz_io * 2;
+    nfs_super.bmap_indirect = options.indirect;
+    nfs_super.bounce = (uint8_t *)malloc(NFS_BLKS_SZ(2));
+    nfs_super.zero_blk = (uint8_t *)calloc(1, NFS_BLK_SZ());
+    nfs_cache_init(options.cache_blocks);
+    nfs_dcache_init(options.dcache_entries);
 
     root_dentry = new_dentry("/", NFS_DIR);
+    if (root_dentry == NULL)
+    {
+        return -NFS_ERROR_NOMEM;
+    }
 
     // 读取super
     if (nfs_driver_read(NFS_SUPER_OFS, (uint8_t *)(&nfs_super_d),
@@ -689,32 +1687,41 @@ int nfs_mount(struct custom_options options)
     if (nfs_super_d.magic != NFS_MAGIC_NUM)
     { 
         /* 幻数无则重建磁盘 */
-        /* 规定各部分大小 */
+        /* 按磁盘大小规定各部分大小 */
+        total_blks = NFS_DISK_SZ() / NFS_BLK_SZ();
         super_blks = NFS_SUPER_BLOCKS;
-        map_inode_blks = NFS_MAP_INODE_BLOCKS;
-        map_data_blks = NFS_MAP_DATA_BLOCKS;
-        inode_num = NFS_INODE_BLOCKS;
-        data_num = NFS_DATA_BLOCKS;
+        inode_num = total_blks / NFS_INODE_RATIO;
+        inode_blks = NFS_INODE_BLKS(inode_num);
+        map_inode_blks = NFS_ROUND_UP(inode_num, NFS_BLK_SZ() * UINT8_BITS) / (NFS_BLK_SZ() * UINT8_BITS);
+        /* 剩余块分给data位图与数据块: 每个位图块管理BLK_SZ*8个数据块 */
+        rest_blks = total_blks - super_blks - map_inode_blks - inode_blks;
+        map_data_blks = NFS_ROUND_UP(rest_blks, NFS_BLK_SZ() * UINT8_BITS + 1) / (NFS_BLK_SZ() * UINT8_BITS + 1);
+        data_num = rest_blks - map_data_blks;
 
         /* 布局layout */
-        nfs_super.max_ino = inode_num;
-        nfs_super.max_data = data_num;
+        nfs_super_d.max_ino = inode_num;
+        nfs_super_d.max_data = data_num;
 
         nfs_super_d.magic = NFS_MAGIC_NUM;
         nfs_super_d.map_inode_offset = NFS_SUPER_OFS + NFS_BLKS_SZ(super_blks);
         nfs_super_d.map_data_offset = nfs_super_d.map_inode_offset + NFS_BLKS_SZ(map_inode_blks);
 
         nfs_super_d.inode_offset = nfs_super_d.map_data_offset + NFS_BLKS_SZ(map_data_blks);
-        nfs_super_d.data_offset = nfs_super_d.inode_offset + NFS_BLKS_SZ(inode_num);
+        nfs_super_d.data_offset = nfs_super_d.inode_offset + NFS_BLKS_SZ(inode_blks);
 
         nfs_super_d.map_inode_blks = map_inode_blks;
         nfs_super_d.map_data_blks = map_data_blks;
 
         nfs_super_d.sz_usage = 0;
-        NFS_DBG("inode map blocks: %d\n", map_inode_blks);
+        nfs_super_d.free_ino = inode_num;
+        nfs_super_d.free_data = data_num;
+        NFS_DBG("inode map blocks: %d, inode blocks: %d, data blocks: %d\n", 
+                map_inode_blks, inode_blks, data_num);
         is_init = TRUE;
     }
     nfs_super.sz_usage = nfs_super_d.sz_usage; /* 建立 in-memory 结构 */
+    nfs_super.max_ino = nfs_super_d.max_ino;
+    nfs_super.max_data = nfs_super_d.max_data;
 
     nfs_super.map_inode = (uint8_t *)malloc(NFS_BLKS_SZ(nfs_super_d.map_inode_blks));
     nfs_super.map_inode_blks = nfs_super_d.map_inode_blks;
@@ -727,6 +1734,19 @@ int nfs_mount(struct custom_options options)
     nfs_super.inode_offset = nfs_super_d.inode_offset;
     nfs_super.data_offset = nfs_super_d.data_offset;
 
+    // 位图与根节点互不依赖，一次异步预读
+    if (nfs_super.cache.capacity > 0 && !is_init)
+    {
+        int blks[DDRIVER_QUEUE_DEPTH];
+        int blk_cnt = 0, i;
+        blks[blk_cnt++] = NFS_INO_BLK(NFS_ROOT_INO);
+        for (i = 0; i < nfs_super.map_inode_blks && blk_cnt < DDRIVER_QUEUE_DEPTH; i++)
+            blks[blk_cnt++] = nfs_super.map_inode_offset / NFS_BLK_SZ() + i;
+        for (i = 0; i < nfs_super.map_data_blks && blk_cnt < DDRIVER_QUEUE_DEPTH; i++)
+            blks[blk_cnt++] = nfs_super.map_data_offset / NFS_BLK_SZ() + i;
+        nfs_cache_prefetch(blks, blk_cnt);
+    }
+
     // 读取两个位图
     if (nfs_driver_read(nfs_super_d.map_inode_offset, (uint8_t *)(nfs_super.map_inode),
                         NFS_BLKS_SZ(nfs_super_d.map_inode_blks)) != NFS_ERROR_NONE)
@@ -738,8 +1758,14 @@ int nfs_mount(struct custom_options options)
     {
         return -NFS_ERROR_IO;
     }
-
-
+    if (is_init)
+    {
+        // 重建时丢弃磁盘上旧文件系统的位图
+        memset(nfs_super.map_inode, 0, NFS_BLKS_SZ(nfs_super.map_inode_blks));
+        memset(nfs_super.map_data, 0, NFS_BLKS_SZ(nfs_super.map_data_blks));
+    }
+    nfs_bitmap_init(&nfs_super.inode_bm, nfs_super.map_inode, nfs_super.max_ino, nfs_super_d.free_ino);
+    nfs_bitmap_init(&nfs_super.data_bm, nfs_super.map_data, nfs_super.max_data, nfs_super_d.free_data);
 
     if (is_init)
     { /* 分配根节点 */
@@ -748,6 +1774,10 @@ int nfs_mount(struct custom_options options)
     }
 
     root_inode = nfs_read_inode(root_dentry, NFS_ROOT_INO);
+    if (root_inode == NULL)
+    {
+        return -NFS_ERROR_IO;
+    }
     root_dentry->inode = root_inode;
     nfs_super.root_dentry = root_dentry;
     nfs_super.is_mounted = TRUE;
@@ -770,10 +1800,17 @@ int nfs_umount()
         return NFS_ERROR_NONE;
     }
 
-    nfs_sync_inode(nfs_super.root_dentry->inode); /* 从根节点向下刷写节点 */
+    if (nfs_sync_dirty() != NFS_ERROR_NONE) /* 只写回有变化的inode与目录块 */
+    {
+        return -NFS_ERROR_IO;
+    }
 
     nfs_super_d.magic = NFS_MAGIC_NUM;
     nfs_super_d.sz_usage = nfs_super.sz_usage;
+    nfs_super_d.max_ino = nfs_super.max_ino;
+    nfs_super_d.max_data = nfs_super.max_data;
+    nfs_super_d.free_ino = nfs_super.inode_bm.free_cnt;
+    nfs_super_d.free_data = nfs_super.data_bm.free_cnt;
 
     nfs_super_d.map_inode_blks = nfs_super.map_inode_blks;
     nfs_super_d.map_inode_offset = nfs_super.map_inode_offset;
@@ -801,8 +1838,18 @@ int nfs_umount()
         return -NFS_ERROR_IO;
     }
 
+    if (nfs_cache_flush() != NFS_ERROR_NONE)
+    {
+        return -NFS_ERROR_IO;
+    }
+    nfs_dump_stat();
+    nfs_cache_destroy();
+    nfs_dcache_destroy();
+
     free(nfs_super.map_inode);
     free(nfs_super.map_data);
+    free(nfs_super.bounce);
+    free(nfs_super.zero_blk);
     ddriver_close(NFS_DRIVER());
 
     return NFS_ERROR_NONE;
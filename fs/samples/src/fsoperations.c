@@ -1,5 +1,17 @@
 #include "../include/fsoperations.h"
 
+// Fill the attributes kept in the tree node; the file size needs the data blocks, so it is left to getattr
+static void fill_node_stat(FStree * node, struct stat *st){
+	memset(st, 0, sizeof(struct stat));
+	st->st_nlink = (strcmp(node->type, "directory") == 0 ? 2 : 1) + node->num_children;
+	st->st_mode = node->permissions;
+	st->st_uid = node->user_id;
+	st->st_gid = node->group_id;
+	st->st_atime = node->a_time;
+	st->st_mtime = node->m_time;
+	st->st_ctime = node->c_time;
+}
+
 int do_getattr(const char *path, struct stat *st){
 	printf( "GETATTR CALLED\n" );
 	printf(">>>>>>>>>>>>>>>> call get attr : %s\n", path);
@@ -18,11 +30,8 @@ int do_getattr(const char *path, struct stat *st){
 		return -ENOENT;
 	}
 	else{
-		if (strcmp(dir_node->type, "directory") == 0){
-			st->st_nlink = 2;
-		}
-		else{
-		 	st->st_nlink = 1;
+		fill_node_stat(dir_node, st);
+		if (strcmp(dir_node->type, "directory") != 0){
 			char * temp = deserialize_file_data(dir_node->inode_number);
 			if(temp!='\0'){
 				load_file(path,temp);
@@ -36,25 +45,17 @@ int do_getattr(const char *path, struct stat *st){
 			}
 		 }
 	 }
-	st->st_nlink += dir_node->num_children;
-	st->st_mode = dir_node->permissions;
-	st->st_uid = dir_node->user_id; 
-	st->st_gid = dir_node->group_id;
-	st->st_atime = dir_node->a_time;
-	st->st_mtime = dir_node->m_time;
-	st->st_ctime = dir_node->c_time;
 	return 0;
 }
 	
 int do_readdir(const char *path, void *buffer, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi ){
 	printf("READDIR CALLED\n");
 		
-	filler(buffer, ".", NULL, 0 ); 
-	filler(buffer, "..", NULL, 0 );
-		
 	char * copy_path = (char *)path;
-	int i = 0;
+	int i = offset;
+	const char * name;
 	FStree * dir_node = NULL;
+	struct stat st;
 
 	if(strlen(copy_path) > 1){
 		dir_node = search_node(copy_path);
@@ -68,8 +69,20 @@ int do_readdir(const char *path, void *buffer, fuse_fill_dir_t filler, off_t off
 	}
 	else{
 		dir_node->a_time=time(NULL);
-		for(i = 0; i < dir_node->num_children; i++){
-			filler( buffer, dir_node->children[i]->name, NULL, 0 );
+		// offsets 0 and 1 are "." and "..", then children[offset - 2]; resume at offset until the buffer is full
+		for(; i < dir_node->num_children + 2; i++){
+			if(i < 2){
+				name = i == 0 ? "." : "..";
+				if(filler( buffer, name, NULL, i + 1 )){
+					break;
+				}
+				continue;
+			}
+			// hand the child's attributes to the kernel along with its name
+			fill_node_stat(dir_node->children[i - 2], &st);
+			if(filler( buffer, dir_node->children[i - 2]->name, &st, i + 1 )){
+				break;
+			}
 		}
 	}
 	return 0;
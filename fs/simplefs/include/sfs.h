@@ -23,8 +23,8 @@
 *******************************************************************************/
 char* 			   sfs_get_fname(const char* path);
 int 			   sfs_calc_lvl(const char * path);
-int 			   sfs_driver_read(int offset, uint8_t *out_content, int size);
-int 			   sfs_driver_write(int offset, uint8_t *in_content, int size);
+int 			   sfs_driver_read(off_t offset, uint8_t *out_content, int size);
+int 			   sfs_driver_write(off_t offset, uint8_t *in_content, int size);
 
 
 int 			   sfs_mount(struct custom_options options);
@@ -53,6 +53,10 @@ int   			   sfs_write(const char *, const char *, size_t, off_t,
 					         struct fuse_file_info *);
 int   			   sfs_read(const char *, char *, size_t, off_t,
 					        struct fuse_file_info *);
+int   			   sfs_write_buf(const char *, struct fuse_bufvec *, off_t,
+					             struct fuse_file_info *);
+int   			   sfs_read_buf(const char *, struct fuse_bufvec **, size_t, off_t,
+					            struct fuse_file_info *);
 int   			   sfs_unlink(const char *);
 int   			   sfs_rmdir(const char *);
 int   			   sfs_rename(const char *, const char *);
@@ -63,6 +67,8 @@ int 			   sfs_readlink(const char *, char *, size_t);
 			
 int   			   sfs_open(const char *, struct fuse_file_info *);
 int   			   sfs_opendir(const char *, struct fuse_file_info *);
+int   			   sfs_release(const char *, struct fuse_file_info *);
+int   			   sfs_releasedir(const char *, struct fuse_file_info *);
 int   			   sfs_access(const char *, int);
 /******************************************************************************
 * SECTION: sfs_debug.c
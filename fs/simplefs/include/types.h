@@ -20,7 +20,7 @@ typedef enum sfs_file_type {
 #define UINT32_BITS             32
 #define UINT8_BITS              8
 
-#define SFS_MAGIC_NUM           0x52415453  
+#define SFS_MAGIC_NUM           0x52415454  /* 布局改为64位偏移后更换 */
 #define SFS_SUPER_OFS           0
 #define SFS_ROOT_INO            0
 
@@ -36,6 +36,7 @@ typedef enum sfs_file_type {
 #define SFS_ERROR_UNSUPPORTED   ENXIO
 #define SFS_ERROR_IO            EIO     /* Error Input/Output */
 #define SFS_ERROR_INVAL         EINVAL  /* Invalid Args */
+#define SFS_ERROR_NOMEM         ENOMEM
 
 #define SFS_MAX_FILE_NAME       128
 #define SFS_INODE_PER_FILE      1
@@ -57,16 +58,17 @@ typedef enum sfs_file_type {
 #define SFS_ROUND_DOWN(value, round)    (value % round == 0 ? value : (value / round) * round)
 #define SFS_ROUND_UP(value, round)      (value % round == 0 ? value : (value / round + 1) * round)
 
-#define SFS_BLKS_SZ(blks)               (blks * SFS_IO_SZ())
+#define SFS_BLKS_SZ(blks)               ((uint64_t)(blks) * SFS_IO_SZ())
 #define SFS_ASSIGN_FNAME(psfs_dentry, _fname)\ 
                                         memcpy(psfs_dentry->fname, _fname, strlen(_fname))
-#define SFS_INO_OFS(ino)                (sfs_super.data_offset + ino * SFS_BLKS_SZ((\
+#define SFS_INO_OFS(ino)                (sfs_super.data_offset + (uint64_t)(ino) * SFS_BLKS_SZ((\
                                         SFS_INODE_PER_FILE + SFS_DATA_PER_FILE)))
 #define SFS_DATA_OFS(ino)               (SFS_INO_OFS(ino) + SFS_BLKS_SZ(SFS_INODE_PER_FILE))
 
 #define SFS_IS_DIR(pinode)              (pinode->dentry->ftype == SFS_DIR)
 #define SFS_IS_REG(pinode)              (pinode->dentry->ftype == SFS_REG_FILE)
 #define SFS_IS_SYM_LINK(pinode)         (pinode->dentry->ftype == SFS_SYM_LINK)
+#define SFS_HANDLE(fi)                  ((struct sfs_handle *)(uintptr_t)(fi)->fh)
 /******************************************************************************
 * SECTION: FS Specific Structure - In memory structure
 *******************************************************************************/
@@ -88,8 +90,19 @@ struct sfs_inode
     struct sfs_dentry* dentry;                        /* 指向该inode的dentry */
     struct sfs_dentry* dentrys;                       /* 所有目录项 */
     uint8_t*           data;           
+    int                dir_gen;                       /* 目录项增删时加1，readdir游标据此判断是否仍有效 */
+    int                open_cnt;                      /* 打开的句柄数，不为0时unlink推迟到最后一次release */
+    boolean            unlinked;                      /* 已从目录中删除，等待最后一个句柄关闭 */
 };  
 
+struct sfs_handle
+{
+    struct sfs_inode*  inode;                         /* open/opendir时解析出的inode */
+    int                dir_cursor;                    /* readdir游标，下一个要返回的目录项序号 */
+    struct sfs_dentry* dir_next;                      /* 序号为dir_cursor的目录项，免去从链表头数起 */
+    int                dir_gen;                       /* 记录游标时目录的dir_gen */
+};
+
 struct sfs_dentry
 {
     char               fname[SFS_MAX_FILE_NAME];
@@ -105,15 +118,15 @@ struct sfs_super
     int                driver_fd;
     
     int                sz_io;
-    int                sz_disk;
+    uint64_t           sz_disk;
     int                sz_usage;
     
     int                max_ino;
     uint8_t*           map_inode;
     int                map_inode_blks;
-    int                map_inode_offset;
+    uint64_t           map_inode_offset;
     
-    int                data_offset;
+    uint64_t           data_offset;
 
     boolean            is_mounted;
 
@@ -140,8 +153,8 @@ struct sfs_super_d
     
     int                max_ino;
     int                map_inode_blks;
-    int                map_inode_offset;
-    int                data_offset;
+    uint64_t           map_inode_offset;
+    uint64_t           data_offset;
 };
 
 struct sfs_inode_d
@@ -27,6 +27,8 @@ static struct fuse_operations operations = {
 	.mknod = sfs_mknod,							      /* 创建文件，touch相关 */
 	.write = sfs_write,								  /* 写入文件 */
 	.read = sfs_read,								  /* 读文件 */
+	.write_buf = sfs_write_buf,						  /* 写入文件，数据直接从FUSE缓冲区拷入 */
+	.read_buf = sfs_read_buf,						  /* 读文件，直接返回文件数据的位置 */
 	.utimens = sfs_utimens,							  /* 修改时间，忽略，避免touch报错 */
 	.truncate = sfs_truncate,						  /* 改变文件大小 */
 	.unlink = sfs_unlink,							  /* 删除文件 */
@@ -59,6 +61,23 @@ void sfs_destroy(void* p) {
 	}
 	return;
 }
+/**
+ * @brief 取打开句柄中的inode，没有句柄时才解析路径
+ * 
+ * @param path 
+ * @param fi 可为NULL
+ * @return struct sfs_inode* 路径不存在时返回NULL
+ */
+static struct sfs_inode* sfs_fi_inode(const char* path, struct fuse_file_info* fi) {
+	boolean	is_find, is_root;
+	struct sfs_dentry* dentry;
+
+	if (fi && fi->fh) {
+		return SFS_HANDLE(fi)->inode;
+	}
+	dentry = sfs_lookup(path, &is_find, &is_root);
+	return is_find ? dentry->inode : NULL;
+}
 /**
  * @brief 
  * 
@@ -91,38 +110,59 @@ int sfs_mkdir(const char* path, mode_t mode) {
 	return SFS_ERROR_NONE;
 }
 /**
- * @brief 获取文件属性
+ * @brief 按dentry填充属性，getattr与readdir共用。类型取自dentry，
+ * inode已载入时才填大小，未载入的不为此读盘
  * 
- * @param path 相对于挂载点的路径
+ * @param dentry 
  * @param sfs_stat 返回状态
- * @return int 
  */
-int sfs_getattr(const char* path, struct stat * sfs_stat) {
-	boolean	is_find, is_root;
-	struct sfs_dentry* dentry = sfs_lookup(path, &is_find, &is_root);
-	if (is_find == FALSE) {
-		return -SFS_ERROR_NOTFOUND;
-	}
+static void sfs_fill_stat(struct sfs_dentry* dentry, struct stat * sfs_stat) {
+	struct sfs_inode* inode = dentry->inode;
 
-	if (SFS_IS_DIR(dentry->inode)) {
+	memset(sfs_stat, 0, sizeof(struct stat));
+	if (dentry->ftype == SFS_DIR) {
 		sfs_stat->st_mode = S_IFDIR | SFS_DEFAULT_PERM;
-		sfs_stat->st_size = dentry->inode->dir_cnt * sizeof(struct sfs_dentry_d);
+		if (inode) {
+			sfs_stat->st_size = inode->dir_cnt * sizeof(struct sfs_dentry_d);
+		}
 	}
-	else if (SFS_IS_REG(dentry->inode)) {
+	else if (dentry->ftype == SFS_REG_FILE) {
 		sfs_stat->st_mode = S_IFREG | SFS_DEFAULT_PERM;
-		sfs_stat->st_size = dentry->inode->size;
+		if (inode) {
+			sfs_stat->st_size = inode->size;
+		}
 	}
-	else if (SFS_IS_SYM_LINK(dentry->inode)) {
+	else if (dentry->ftype == SFS_SYM_LINK) {
 		sfs_stat->st_mode = S_IFLNK | SFS_DEFAULT_PERM;
-		sfs_stat->st_size = dentry->inode->size;
+		if (inode) {
+			sfs_stat->st_size = inode->size;
+		}
 	}
 
+	sfs_stat->st_ino	 = dentry->ino;
 	sfs_stat->st_nlink = 1;
 	sfs_stat->st_uid 	 = getuid();
 	sfs_stat->st_gid 	 = getgid();
 	sfs_stat->st_atime   = time(NULL);
 	sfs_stat->st_mtime   = time(NULL);
 	sfs_stat->st_blksize = SFS_IO_SZ();
+}
+
+/**
+ * @brief 获取文件属性
+ * 
+ * @param path 相对于挂载点的路径
+ * @param sfs_stat 返回状态
+ * @return int 
+ */
+int sfs_getattr(const char* path, struct stat * sfs_stat) {
+	boolean	is_find, is_root;
+	struct sfs_dentry* dentry = sfs_lookup(path, &is_find, &is_root);
+	if (is_find == FALSE) {
+		return -SFS_ERROR_NOTFOUND;
+	}
+
+	sfs_fill_stat(dentry, sfs_stat);
 
 	if (is_root) {
 		sfs_stat->st_size	= sfs_super.sz_usage; 
@@ -142,7 +182,7 @@ int sfs_getattr(const char* path, struct stat * sfs_stat) {
  *				const struct stat *stbuf, off_t off)
  * buf: name会被复制到buf中
  * name: dentry名字
- * stbuf: 文件状态，可忽略
+ * stbuf: 文件状态，这里按dentry填充，免去逐项getattr
  * off: 下一次offset从哪里开始，这里可以理解为第几个dentry
  * 
  * @param offset 
@@ -151,17 +191,32 @@ int sfs_getattr(const char* path, struct stat * sfs_stat) {
  */
 int sfs_readdir(const char * path, void * buf, fuse_fill_dir_t filler, off_t offset,
 			    struct fuse_file_info * fi) {
-    boolean	is_find, is_root;
 	int		cur_dir = offset;
 
-	struct sfs_dentry* dentry = sfs_lookup(path, &is_find, &is_root);
+	struct sfs_inode* inode = sfs_fi_inode(path, fi);
+	struct sfs_handle* handle = fi ? SFS_HANDLE(fi) : NULL;
 	struct sfs_dentry* sub_dentry;
-	struct sfs_inode* inode;
-	if (is_find) {
-		inode = dentry->inode;
-		sub_dentry = sfs_get_dentry(inode, cur_dir);
-		if (sub_dentry) {
-			filler(buf, sub_dentry->fname, NULL, ++offset);
+	struct stat sub_stat;
+	if (inode) {
+		/* 上次停在这里且目录未变，直接从游标继续，否则才从链表头数起 */
+		if (handle && handle->dir_cursor == cur_dir && handle->dir_gen == inode->dir_gen) {
+			sub_dentry = handle->dir_next;
+		}
+		else {
+			sub_dentry = sfs_get_dentry(inode, cur_dir);
+		}
+		while (sub_dentry) {
+			sfs_fill_stat(sub_dentry, &sub_stat);
+			if (filler(buf, sub_dentry->fname, &sub_stat, cur_dir + 1)) {
+				break;
+			}
+			sub_dentry = sub_dentry->brother;
+			cur_dir++;
+		}
+		if (handle) {
+			handle->dir_cursor = cur_dir;
+			handle->dir_next = sub_dentry;
+			handle->dir_gen = inode->dir_gen;
 		}
 		return SFS_ERROR_NONE;
 	}
@@ -216,15 +271,11 @@ int sfs_mknod(const char* path, mode_t mode, dev_t dev) {
  */
 int sfs_write(const char* path, const char* buf, size_t size, off_t offset,
 		        struct fuse_file_info* fi) {
-    boolean	is_find, is_root;
-	struct sfs_dentry* dentry = sfs_lookup(path, &is_find, &is_root);
-	struct sfs_inode*  inode;
+	struct sfs_inode*  inode = sfs_fi_inode(path, fi);
 	
-	if (is_find == FALSE) {
+	if (inode == NULL) {
 		return -SFS_ERROR_NOTFOUND;
 	}
-
-	inode = dentry->inode;
 	
 	if (SFS_IS_DIR(inode)) {
 		return -SFS_ERROR_ISDIR;	
@@ -251,15 +302,11 @@ int sfs_write(const char* path, const char* buf, size_t size, off_t offset,
  */
 int sfs_read(const char* path, char* buf, size_t size, off_t offset,
 		       struct fuse_file_info* fi) {
-	boolean	is_find, is_root;
-	struct sfs_dentry* dentry = sfs_lookup(path, &is_find, &is_root);
-	struct sfs_inode*  inode;
-
-	if (is_find == FALSE) {
+	struct sfs_inode*  inode = sfs_fi_inode(path, fi);
+	
+	if (inode == NULL) {
 		return -SFS_ERROR_NOTFOUND;
 	}
-
-	inode = dentry->inode;
 	
 	if (SFS_IS_DIR(inode)) {
 		return -SFS_ERROR_ISDIR;	
@@ -273,6 +320,83 @@ int sfs_read(const char* path, char* buf, size_t size, off_t offset,
 
 	return size;			   
 }
+/**
+ * @brief 文件数据常驻内存，FUSE传入的数据(可能仍在管道中)直接拷入inode->data，
+ * 不经中间缓冲区
+ * 
+ * @param path 
+ * @param buf 
+ * @param offset 
+ * @param fi 
+ * @return int 
+ */
+int sfs_write_buf(const char* path, struct fuse_bufvec* buf, off_t offset,
+		          struct fuse_file_info* fi) {
+	struct sfs_inode*  inode = sfs_fi_inode(path, fi);
+	size_t size = fuse_buf_size(buf);
+	struct fuse_bufvec dst = FUSE_BUFVEC_INIT(size);
+	ssize_t res;
+	
+	if (inode == NULL) {
+		return -SFS_ERROR_NOTFOUND;
+	}
+	
+	if (SFS_IS_DIR(inode)) {
+		return -SFS_ERROR_ISDIR;	
+	}
+
+	if (inode->size < offset) {
+		return -SFS_ERROR_SEEK;
+	}
+
+	if (offset + size > SFS_BLKS_SZ(SFS_DATA_PER_FILE)) {
+		return -SFS_ERROR_NOSPACE;
+	}
+
+	dst.buf[0].mem = inode->data + offset;
+	res = fuse_buf_copy(&dst, buf, 0);
+	if (res > 0) {
+		inode->size = offset + res > inode->size ? offset + res : inode->size;
+	}
+	return res;
+}
+/**
+ * @brief 返回指向inode->data的bufvec，由FUSE直接从文件数据回复
+ * 
+ * @param path 
+ * @param bufp 
+ * @param size 
+ * @param offset 
+ * @param fi 
+ * @return int 
+ */
+int sfs_read_buf(const char* path, struct fuse_bufvec** bufp, size_t size, off_t offset,
+		         struct fuse_file_info* fi) {
+	struct sfs_inode*  inode = sfs_fi_inode(path, fi);
+	struct fuse_bufvec* bufv;
+	
+	if (inode == NULL) {
+		return -SFS_ERROR_NOTFOUND;
+	}
+	
+	if (SFS_IS_DIR(inode)) {
+		return -SFS_ERROR_ISDIR;	
+	}
+
+	if (inode->size < offset) {
+		return -SFS_ERROR_SEEK;
+	}
+
+	bufv = (struct fuse_bufvec *)malloc(sizeof(struct fuse_bufvec));
+	if (bufv == NULL) {
+		return -SFS_ERROR_NOMEM;
+	}
+	size = offset + size > inode->size ? inode->size - offset : size;
+	*bufv = FUSE_BUFVEC_INIT(size);
+	bufv->buf[0].mem = inode->data + offset;
+	*bufp = bufv;
+	return SFS_ERROR_NONE;
+}
 /**
  * @brief 
  * 
@@ -290,8 +414,12 @@ int sfs_unlink(const char* path) {
 
 	inode = dentry->inode;
 
-	sfs_drop_inode(inode);
 	sfs_drop_dentry(dentry->parent->inode, dentry);
+	if (inode->open_cnt > 0) {						  /* 仍被打开，最后一次release时释放 */
+		inode->unlinked = TRUE;
+		return SFS_ERROR_NONE;
+	}
+	sfs_drop_inode(inode);
 	return SFS_ERROR_NONE;
 }
 /**
@@ -404,13 +532,31 @@ int sfs_readlink (const char *path, char *buf, size_t size){
 	return SFS_ERROR_NONE;
 }
 /**
- * @brief 
+ * @brief 建立句柄存入fi->fh，之后的read/write/readdir直接取其中的inode
  * 
  * @param path 
  * @param fi 
  * @return int 
  */
 int sfs_open(const char* path, struct fuse_file_info* fi) {
+	boolean	is_find, is_root;
+	struct sfs_dentry* dentry = sfs_lookup(path, &is_find, &is_root);
+	struct sfs_handle* handle;
+
+	if (is_find == FALSE) {
+		return -SFS_ERROR_NOTFOUND;
+	}
+
+	handle = (struct sfs_handle *)malloc(sizeof(struct sfs_handle));
+	if (handle == NULL) {
+		return -SFS_ERROR_NOMEM;
+	}
+	handle->inode = dentry->inode;
+	handle->dir_cursor = 0;
+	handle->dir_next = dentry->inode->dentrys;
+	handle->dir_gen = dentry->inode->dir_gen;
+	dentry->inode->open_cnt++;
+	fi->fh = (uint64_t)(uintptr_t)handle;
 	return SFS_ERROR_NONE;
 }
 /**
@@ -421,8 +567,38 @@ int sfs_open(const char* path, struct fuse_file_info* fi) {
  * @return int 
  */
 int sfs_opendir(const char* path, struct fuse_file_info* fi) {
+	return sfs_open(path, fi);
+}
+/**
+ * @brief 释放open时建立的句柄，最后一个句柄关闭时释放打开期间已被删除的inode
+ * 
+ * @param path 
+ * @param fi 
+ * @return int 
+ */
+int sfs_release(const char* path, struct fuse_file_info* fi) {
+	struct sfs_handle* handle = SFS_HANDLE(fi);
+
+	if (handle == NULL) {
+		return SFS_ERROR_NONE;
+	}
+	if (--handle->inode->open_cnt == 0 && handle->inode->unlinked) {
+		sfs_drop_inode(handle->inode);
+	}
+	free(handle);
+	fi->fh = 0;
 	return SFS_ERROR_NONE;
 }
+/**
+ * @brief 
+ * 
+ * @param path 
+ * @param fi 
+ * @return int 
+ */
+int sfs_releasedir(const char* path, struct fuse_file_info* fi) {
+	return sfs_release(path, fi);
+}
 /**
  * @brief 
  * 
@@ -45,20 +45,16 @@ int sfs_calc_lvl(const char * path) {
  * @param size 
  * @return int 
  */
-int sfs_driver_read(int offset, uint8_t *out_content, int size) {
-    int      offset_aligned = SFS_ROUND_DOWN(offset, SFS_IO_SZ());
+int sfs_driver_read(off_t offset, uint8_t *out_content, int size) {
+    off_t    offset_aligned = SFS_ROUND_DOWN(offset, SFS_IO_SZ());
     int      bias           = offset - offset_aligned;
     int      size_aligned   = SFS_ROUND_UP((size + bias), SFS_IO_SZ());
     uint8_t* temp_content   = (uint8_t*)malloc(size_aligned);
-    uint8_t* cur            = temp_content;
-    // lseek(SFS_DRIVER(), offset_aligned, SEEK_SET);
-    ddriver_seek(SFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
-    {
-        // read(SFS_DRIVER(), cur, SFS_IO_SZ());
-        ddriver_read(SFS_DRIVER(), cur, SFS_IO_SZ());
-        cur          += SFS_IO_SZ();
-        size_aligned -= SFS_IO_SZ();   
+                                                      /* 一次定位请求读出整段对齐区域 */
+    if (ddriver_pread(SFS_DRIVER(), (char *)temp_content, size_aligned,
+                      offset_aligned) != size_aligned) {
+        free(temp_content);
+        return -SFS_ERROR_IO;
     }
     memcpy(out_content, temp_content + bias, size);
     free(temp_content);
@@ -72,23 +68,19 @@ int sfs_driver_read(int offset, uint8_t *out_content, int size) {
  * @param size 
  * @return int 
  */
-int sfs_driver_write(int offset, uint8_t *in_content, int size) {
-    int      offset_aligned = SFS_ROUND_DOWN(offset, SFS_IO_SZ());
+int sfs_driver_write(off_t offset, uint8_t *in_content, int size) {
+    off_t    offset_aligned = SFS_ROUND_DOWN(offset, SFS_IO_SZ());
     int      bias           = offset - offset_aligned;
     int      size_aligned   = SFS_ROUND_UP((size + bias), SFS_IO_SZ());
     uint8_t* temp_content   = (uint8_t*)malloc(size_aligned);
-    uint8_t* cur            = temp_content;
     sfs_driver_read(offset_aligned, temp_content, size_aligned);
     memcpy(temp_content + bias, in_content, size);
     
-    // lseek(SFS_DRIVER(), offset_aligned, SEEK_SET);
-    ddriver_seek(SFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
-    {
-        // write(SFS_DRIVER(), cur, SFS_IO_SZ());
-        ddriver_write(SFS_DRIVER(), cur, SFS_IO_SZ());
-        cur          += SFS_IO_SZ();
-        size_aligned -= SFS_IO_SZ();   
+                                                      /* 一次定位请求写回整段对齐区域 */
+    if (ddriver_pwrite(SFS_DRIVER(), (char *)temp_content, size_aligned,
+                       offset_aligned) != size_aligned) {
+        free(temp_content);
+        return -SFS_ERROR_IO;
     }
 
     free(temp_content);
@@ -110,6 +102,7 @@ int sfs_alloc_dentry(struct sfs_inode* inode, struct sfs_dentry* dentry) {
         inode->dentrys = dentry;
     }
     inode->dir_cnt++;
+    inode->dir_gen++;
     return inode->dir_cnt;
 }
 /**
@@ -143,6 +136,7 @@ int sfs_drop_dentry(struct sfs_inode * inode, struct sfs_dentry * dentry) {
         return -SFS_ERROR_NOTFOUND;
     }
     inode->dir_cnt--;
+    inode->dir_gen++;
     return inode->dir_cnt;
 }
 /**
@@ -189,6 +183,9 @@ struct sfs_inode* sfs_alloc_inode(struct sfs_dentry * dentry) {
     
     inode->dir_cnt = 0;
     inode->dentrys = NULL;
+    inode->dir_gen = 0;
+    inode->open_cnt = 0;
+    inode->unlinked = FALSE;
     
     if (SFS_IS_REG(inode)) {
         inode->data = (uint8_t *)malloc(SFS_BLKS_SZ(SFS_DATA_PER_FILE));
@@ -212,7 +209,7 @@ int sfs_sync_inode(struct sfs_inode * inode) {
     memcpy(inode_d.target_path, inode->target_path, SFS_MAX_FILE_NAME);
     inode_d.ftype       = inode->dentry->ftype;
     inode_d.dir_cnt     = inode->dir_cnt;
-    int offset;
+    off_t offset;
     
     if (sfs_driver_write(SFS_INO_OFS(ino), (uint8_t *)&inode_d, 
                      sizeof(struct sfs_inode_d)) != SFS_ERROR_NONE) {
@@ -353,6 +350,9 @@ struct sfs_inode* sfs_read_inode(struct sfs_dentry * dentry, int ino) {
     memcpy(inode->target_path, inode_d.target_path, SFS_MAX_FILE_NAME);
     inode->dentry = dentry;
     inode->dentrys = NULL;
+    inode->dir_gen = 0;
+    inode->open_cnt = 0;
+    inode->unlinked = FALSE;
     if (SFS_IS_DIR(inode)) {
         dir_cnt = inode_d.dir_cnt;
         for (i = 0; i < dir_cnt; i++)
@@ -516,7 +516,7 @@ int sfs_mount(struct custom_options options){
     }
 
     sfs_super.driver_fd = driver_fd;
-    ddriver_ioctl(SFS_DRIVER(), IOC_REQ_DEVICE_SIZE,  &sfs_super.sz_disk);
+    ddriver_ioctl(SFS_DRIVER(), IOC_REQ_DEVICE_SIZE64, &sfs_super.sz_disk);
     ddriver_ioctl(SFS_DRIVER(), IOC_REQ_DEVICE_IO_SZ, &sfs_super.sz_io);
     
     root_dentry = new_dentry("/", SFS_DIR);
@@ -536,7 +536,7 @@ int sfs_mount(struct custom_options options){
                          / SFS_IO_SZ();
         
                                                       /* 布局layout */
-        sfs_super.max_ino = (inode_num - super_blks - map_inode_blks); 
+        sfs_super_d.max_ino = (inode_num - super_blks - map_inode_blks); 
         sfs_super_d.map_inode_offset = SFS_SUPER_OFS + SFS_BLKS_SZ(super_blks);
         sfs_super_d.data_offset = sfs_super_d.map_inode_offset + SFS_BLKS_SZ(map_inode_blks);
         sfs_super_d.map_inode_blks  = map_inode_blks;
@@ -545,6 +545,7 @@ int sfs_mount(struct custom_options options){
         is_init = TRUE;
     }
     sfs_super.sz_usage   = sfs_super_d.sz_usage;      /* 建立 in-memory 结构 */
+    sfs_super.max_ino    = sfs_super_d.max_ino;
     
     sfs_super.map_inode = (uint8_t *)malloc(SFS_BLKS_SZ(sfs_super_d.map_inode_blks));
     sfs_super.map_inode_blks = sfs_super_d.map_inode_blks;
@@ -584,6 +585,7 @@ int sfs_umount() {
     sfs_sync_inode(sfs_super.root_dentry->inode);     /* 从根节点向下刷写节点 */
                                                     
     sfs_super_d.magic_num           = SFS_MAGIC_NUM;
+    sfs_super_d.max_ino             = sfs_super.max_ino;
     sfs_super_d.map_inode_blks      = sfs_super.map_inode_blks;
     sfs_super_d.map_inode_offset    = sfs_super.map_inode_offset;
     sfs_super_d.data_offset         = sfs_super.data_offset;
@@ -3,6 +3,7 @@
 
 #include "ddriver_ctl_user.h"
 #include "stdio.h"
+#include <sys/uio.h>
 
 /**
  * @brief 打开ddriver设备
@@ -18,9 +19,9 @@ int ddriver_open(char *path);
  * @param fd ddriver设备handler
  * @param offset 移动到的位置，注意要和设备IO单位对齐
  * @param whence SEEK_SET即可
- * @return int 0成功，否则失败
+ * @return off_t 磁头新位置，小于0失败
  */
-int ddriver_seek(int fd, off_t offset, int whence);
+off_t ddriver_seek(int fd, off_t offset, int whence);
 
 /**
  * @brief 写入数据
@@ -42,6 +43,124 @@ int ddriver_write(int fd, char *buf, size_t size);
  */
 int ddriver_read(int fd, char *buf, size_t size);
 
+/**
+ * @brief 写入多个连续扇区，只产生一次设备请求
+ * 
+ * @param fd ddriver设备handler
+ * @param buf 要写入的数据Buf
+ * @param size 要写入的数据大小，必须是设备IO单位的整数倍
+ * @return int 写入的字节数，小于0失败
+ */
+int ddriver_writen(int fd, char *buf, size_t size);
+
+/**
+ * @brief 读出多个连续扇区，只产生一次设备请求
+ * 
+ * @param fd ddriver设备handler
+ * @param buf 要读出的数据Buf
+ * @param size 要读出的数据大小，必须是设备IO单位的整数倍
+ * @return int 读出的字节数，小于0失败
+ */
+int ddriver_readn(int fd, char *buf, size_t size);
+
+/**
+ * @brief 向量写入，将多个Buf写入磁盘头之后的连续扇区，只产生一次设备请求
+ * 
+ * @param fd ddriver设备handler
+ * @param iov Buf数组，每段长度必须是设备IO单位的整数倍
+ * @param iovcnt Buf个数
+ * @return int 写入的字节数，小于0失败
+ */
+int ddriver_writev(int fd, const struct iovec *iov, int iovcnt);
+
+/**
+ * @brief 向量读出，将磁盘头之后的连续扇区读入多个Buf，只产生一次设备请求
+ * 
+ * @param fd ddriver设备handler
+ * @param iov Buf数组，每段长度必须是设备IO单位的整数倍
+ * @param iovcnt Buf个数
+ * @return int 读出的字节数，小于0失败
+ */
+int ddriver_readv(int fd, const struct iovec *iov, int iovcnt);
+
+/**
+ * @brief 定位写入，不依赖也不需要先ddriver_seek，可多线程并发调用
+ * 
+ * @param fd ddriver设备handler
+ * @param buf 要写入的数据Buf
+ * @param size 要写入的数据大小，必须是设备IO单位的整数倍
+ * @param offset 写入位置，必须和设备IO单位对齐
+ * @return int 写入的字节数，小于0失败
+ */
+int ddriver_pwrite(int fd, char *buf, size_t size, off_t offset);
+
+/**
+ * @brief 定位读出，不依赖也不需要先ddriver_seek，可多线程并发调用
+ * 
+ * @param fd ddriver设备handler
+ * @param buf 要读出的数据Buf
+ * @param size 要读出的数据大小，必须是设备IO单位的整数倍
+ * @param offset 读出位置，必须和设备IO单位对齐
+ * @return int 读出的字节数，小于0失败
+ */
+int ddriver_pread(int fd, char *buf, size_t size, off_t offset);
+
+/**
+ * @brief 定位向量写入，将多个Buf写入offset起的连续扇区
+ * 
+ * @param fd ddriver设备handler
+ * @param iov Buf数组，每段长度必须是设备IO单位的整数倍
+ * @param iovcnt Buf个数
+ * @param offset 写入位置，必须和设备IO单位对齐
+ * @return int 写入的字节数，小于0失败
+ */
+int ddriver_pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+
+/**
+ * @brief 定位向量读出，将offset起的连续扇区读入多个Buf
+ * 
+ * @param fd ddriver设备handler
+ * @param iov Buf数组，每段长度必须是设备IO单位的整数倍
+ * @param iovcnt Buf个数
+ * @param offset 读出位置，必须和设备IO单位对齐
+ * @return int 读出的字节数，小于0失败
+ */
+int ddriver_preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+
+/**
+ * @brief 为调用者直接在镜像文件上完成的一次传输(如FUSE在管道与文件间splice)
+ * 做检查、记账与延迟模拟，本身不搬运数据
+ * 
+ * @param fd ddriver设备handler
+ * @param offset 传输位置，必须和设备IO单位对齐
+ * @param size 传输大小，必须是设备IO单位的整数倍
+ * @param is_write 非0为写入镜像，0为从镜像读出
+ * @return int 可用于该传输的镜像文件描述符，小于0失败
+ */
+int ddriver_splice(int fd, off_t offset, size_t size, int is_write);
+
+/**
+ * @brief 异步提交一批读写请求，立即返回，设备延迟可相互重叠
+ * 请求先暂存，到ddriver_reap时按调度策略(IOC_REQ_DEVICE_SCHED)排序、合并相接扇区后再下发
+ * 
+ * @param fd ddriver设备handler
+ * @param reqs 请求数组，reap之前请求、iov及Buf须保持有效
+ * @param nr 请求个数，在途请求最多DDRIVER_QUEUE_DEPTH个
+ * @return int 实际提交的请求数，小于0失败
+ */
+int ddriver_submit(int fd, struct ddriver_req *reqs, int nr);
+
+/**
+ * @brief 取回已完成的异步请求
+ * 
+ * @param fd ddriver设备handler
+ * @param done 返回已完成请求的指针，结果见各请求的res
+ * @param min_nr 至少等待完成的请求数
+ * @param max_nr 最多取回的请求数
+ * @return int 取回的请求数，小于0失败
+ */
+int ddriver_reap(int fd, struct ddriver_req **done, int min_nr, int max_nr);
+
 /**
  * @brief ddriver IO控制
  * 
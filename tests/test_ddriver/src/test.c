@@ -1,5 +1,6 @@
 #include "../include/ddriver.h"
 #include <linux/fs.h>
+#include <string.h>
 
 int main(int argc, char const *argv[])
 {
@@ -21,6 +22,62 @@ int main(int argc, char const *argv[])
     ddriver_read(fd, rbuffer, 512);
     printf("%s\n", rbuffer);
 
+    /* Cycle 1.1: multi-sector read/write test */
+    char mbuffer[1024];
+    char mrbuffer[1024];
+    struct iovec iov[2] = {
+        { .iov_base = mrbuffer, .iov_len = 512 },
+        { .iov_base = mrbuffer + 512, .iov_len = 512 }
+    };
+    memset(mbuffer, 'b', 1024);
+    ddriver_seek(fd, 1024, SEEK_SET);
+    if (ddriver_writen(fd, mbuffer, 1024) != 1024) {
+        return -1;
+    }
+    ddriver_seek(fd, 1024, SEEK_SET);
+    if (ddriver_readv(fd, iov, 2) != 1024 || memcmp(mbuffer, mrbuffer, 1024) != 0) {
+        printf("multi-sector mismatch\n");
+        return -1;
+    }
+
+    /* Cycle 1.2: async read/write test */
+    char abuffer[8][512];
+    char arbuffer[8][512];
+    struct iovec aiov[8], ariov[8];
+    struct ddriver_req reqs[8];
+    struct ddriver_req *done[8];
+    int reaped = 0;
+    for (int i = 0; i < 8; i++) {
+        memset(abuffer[i], 'c' + i, 512);
+        aiov[i].iov_base = abuffer[i];
+        aiov[i].iov_len = 512;
+        reqs[i].op = DDRIVER_OP_WRITE;
+        reqs[i].iov = &aiov[i];
+        reqs[i].iovcnt = 1;
+        reqs[i].offset = (8 + i * 16) * 512;
+    }
+    if (ddriver_submit(fd, reqs, 8) != 8) {
+        return -1;
+    }
+    while (reaped < 8) {
+        reaped += ddriver_reap(fd, done + reaped, 1, 8 - reaped);
+    }
+    for (int i = 0; i < 8; i++) {
+        ariov[i].iov_base = arbuffer[i];
+        ariov[i].iov_len = 512;
+        reqs[i].op = DDRIVER_OP_READ;
+        reqs[i].iov = &ariov[i];
+    }
+    if (ddriver_submit(fd, reqs, 8) != 8 || ddriver_reap(fd, done, 8, 8) != 8) {
+        return -1;
+    }
+    for (int i = 0; i < 8; i++) {
+        if (done[i]->res != 512 || memcmp(abuffer[i], arbuffer[i], 512) != 0) {
+            printf("async mismatch\n");
+            return -1;
+        }
+    }
+
     /* Cycle 2: ioctl test - return int */
     ddriver_ioctl(fd, IOC_REQ_DEVICE_SIZE, &size);
     printf("%d\n", size);
@@ -31,6 +88,49 @@ int main(int argc, char const *argv[])
     printf("write_cnt: %d\n", state.write_cnt);
     printf("seek_cnt: %d\n", state.seek_cnt);
 
+    /* Cycle 3.1: ioctl test - seek distance histogram */
+    struct ddriver_seek_hist hist;
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_SEEK_HIST, &hist);
+    for (int i = 0; i < DDRIVER_SEEK_HIST_BUCKETS; i++) {
+        if (hist.bucket[i]) {
+            printf("seek >= %d sectors: %d\n", 1 << i, hist.bucket[i]);
+        }
+    }
+
+    /* Cycle 3.2: ioctl test - detailed statistics */
+    struct ddriver_stats stats;
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_STATS, &stats);
+    if (stats.read_cnt != (uint64_t)state.read_cnt || stats.write_cnt != (uint64_t)state.write_cnt
+        || stats.now_mono_ns < stats.reset_mono_ns) {
+        printf("stats mismatch\n");
+        return -1;
+    }
+    if (stats.read_cnt && stats.read_lat_us % stats.read_cnt != 0) {  /* seek time belongs to seek_lat_us only */
+        printf("seek time counted in read latency\n");
+        return -1;
+    }
+    printf("read: %lu B, %lu us, write: %lu B, %lu us, seek: %lu sectors, %lu us\n", 
+           stats.read_bytes, stats.read_lat_us, stats.write_bytes, stats.write_lat_us,
+           stats.seek_sectors, stats.seek_lat_us);
+    for (int i = 0; i < DDRIVER_LAT_HIST_BUCKETS; i++) {
+        if (stats.read_lat_hist[i] || stats.write_lat_hist[i]) {
+            printf("lat >= %d us: read %u, write %u\n", 1 << i, 
+                   stats.read_lat_hist[i], stats.write_lat_hist[i]);
+        }
+    }
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_STATS_RESET, NULL);
+    ddriver_ioctl(fd, IOC_REQ_DEVICE_STATS, &stats);
+    if (stats.read_cnt != 0 || stats.write_bytes != 0) {
+        printf("stats reset failed\n");
+        return -1;
+    }
+
+    /* Cycle 3.3: ioctl test - flush to image */
+    if (ddriver_ioctl(fd, IOC_REQ_DEVICE_FLUSH, NULL) != 0) {
+        printf("flush failed\n");
+        return -1;
+    }
+
     /* Cycle 4: ioctl test - re-init device */
     ddriver_ioctl(fd, IOC_REQ_DEVICE_RESET, &size);
 